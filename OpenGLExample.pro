@@ -6,6 +6,8 @@
 
 QT       += core gui
 
+CONFIG += c++11
+
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = OpenGLExample
@@ -27,12 +29,36 @@ SOURCES += main.cpp\
         mainwindow.cpp \
     myglwidget.cpp \
     renderobjects.cpp \
-    matsnlights.cpp
+    matsnlights.cpp \
+    gputimer.cpp \
+    dynamicresolution.cpp \
+    jobsystem.cpp \
+    renderqueue.cpp \
+    streambuffer.cpp \
+    occlusionculling.cpp \
+    gltrace.cpp \
+    gltracereplay.cpp \
+    residency.cpp \
+    framerecorder.cpp \
+    meshsimplify.cpp \
+    rendercache.cpp
 
 HEADERS  += mainwindow.h \
     myglwidget.h \
     renderobjects.h \
-    matsnlights.h
+    matsnlights.h \
+    gputimer.h \
+    dynamicresolution.h \
+    jobsystem.h \
+    renderqueue.h \
+    streambuffer.h \
+    occlusionculling.h \
+    gltrace.h \
+    gltracereplay.h \
+    residency.h \
+    framerecorder.h \
+    meshsimplify.h \
+    rendercache.h
 
 FORMS    += mainwindow.ui
 
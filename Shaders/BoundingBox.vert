@@ -0,0 +1,12 @@
+#version 400 core
+
+layout( location = 0 ) in vec4 vPosition;
+uniform mat4 mvp_matrix;
+uniform vec3 box_min;
+uniform vec3 box_max;
+
+void
+main()
+{
+    gl_Position = mvp_matrix*vec4(mix(box_min,box_max,vPosition.xyz),1.0);
+}
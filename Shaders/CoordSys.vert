@@ -1,13 +1,13 @@
 #version 400 core
 
-layout( location = 0 ) in vec4 vPosition;
-layout( location = 1 ) in vec4 vColor;
 uniform mat4 mvp_matrix;
 out vec4 col;
 
 void
 main()
 {
-    col=vColor;
-    gl_Position = mvp_matrix*vPosition;
+    //three lines from the origin along x, y and z, colored by their axis, no vertex attributes
+    vec3 axis=vec3(equal(ivec3(gl_VertexID/2),ivec3(0,1,2)));
+    col=vec4(axis,1.0);
+    gl_Position = mvp_matrix*vec4(axis*float(gl_VertexID%2),1.0);
 }
@@ -2,9 +2,12 @@
 
 layout( location = 0 ) in vec4 vPosition;
 layout( location = 1 ) in vec4 vNormal;
-uniform mat4 mvp_matrix;
-uniform mat4 normal_matrix;
-uniform mat4 modelview_matrix;
+layout( std140 ) uniform PerObject
+{
+    mat4 mvp_matrix;
+    mat4 modelview_matrix;
+    mat4 normal_matrix;
+};
 
 out vec3 norm;
 out vec3 pos;
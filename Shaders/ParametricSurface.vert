@@ -0,0 +1,10 @@
+#version 400 core
+
+layout( location = 0 ) in vec2 vParameter;
+
+out vec2 param;
+
+void main()
+{
+    param=vParameter;
+}
@@ -0,0 +1,32 @@
+#version 400 core
+
+// no vertex attributes: every cell of the grid is two triangles, six vertices
+// addressed by gl_VertexID, covering [-grid_extent,grid_extent] in the xy plane
+uniform vec2 grid_cells;
+uniform vec2 grid_extent;
+layout( std140 ) uniform PerObject
+{
+    mat4 mvp_matrix;
+    mat4 modelview_matrix;
+    mat4 normal_matrix;
+};
+
+out vec3 norm;
+out vec3 pos;
+
+const ivec2 corners[6]=ivec2[6](ivec2(0,0),ivec2(0,1),ivec2(1,1),ivec2(0,0),ivec2(1,1),ivec2(1,0));
+
+void main()
+{
+    int iCellsX=int(grid_cells.x);
+    int iCell=gl_VertexID/6;
+    ivec2 corner=corners[gl_VertexID%6];
+    vec2 grid=vec2(iCell%iCellsX+corner.x,iCell/iCellsX+corner.y);
+    vec4 vPosition=vec4(grid_extent*(2.0*grid/grid_cells-1.0),0.0,1.0);
+    vec4 vNormal=vec4(0.0,0.0,1.0,0.0);
+
+    norm=normalize(vec4(normal_matrix*vNormal).xyz);
+
+    pos=-normalize(vec4(modelview_matrix*vPosition).xyz);
+    gl_Position = mvp_matrix*vPosition;
+}
@@ -0,0 +1,45 @@
+#version 400 core
+
+out vec4 fColor;
+
+in vec3 gNorm;
+in vec3 gPos;
+noperspective in vec3 edgeDistance;
+
+uniform vec3 mat[4];
+uniform float mat_shininess;
+
+// 0: solid, 1: wire, 2: hidden line, 3: solid with wire
+uniform int wire_mode;
+uniform float line_width;
+uniform vec3 wire_color;
+uniform vec3 background_color;
+
+void main()
+{
+    float ndp=max(0.0,dot(normalize(gNorm),normalize(gPos)));
+
+    vec3 diffuse=mat[2]*ndp;
+    vec3 specular=mat[3]*pow(ndp,mat_shininess);
+    vec3 ambient=mat[1]*0.3;
+
+    vec3 finalcol=ambient+diffuse+specular;
+    if (wire_mode==0)
+    {
+        fColor=vec4(finalcol,1.0);
+        return;
+    }
+
+    float dist=min(edgeDistance.x,min(edgeDistance.y,edgeDistance.z));
+    float edge=1.0-smoothstep(line_width*0.5-0.5,line_width*0.5+0.5,dist);
+    if (wire_mode==1)
+    {
+        if (edge<=0.0)
+            discard;
+        fColor=vec4(finalcol,1.0);
+    }
+    else if (wire_mode==2)
+        fColor=vec4(mix(background_color,finalcol,edge),1.0);
+    else
+        fColor=vec4(mix(finalcol,wire_color,edge),1.0);
+}
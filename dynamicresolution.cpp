@@ -0,0 +1,94 @@
+#include "dynamicresolution.h"
+
+#include "gltrace.h"
+#include <QOpenGLFramebufferObject>
+#include <QtMath>
+
+
+CDynamicResolution::CDynamicResolution()
+{}
+CDynamicResolution::~CDynamicResolution()
+{
+    deleteFramebuffer();
+}
+bool CDynamicResolution::initialize(CGLTraceFunctions *functions)
+{
+    gl=functions;
+    if (!gl)
+    {
+        qDebug() << "OpenGLFunctions not initialized or not supported";
+        return false;
+    }
+    return timer.initialize(gl);
+}
+void CDynamicResolution::deleteFramebuffer()
+{
+    delete fbo;
+    fbo=0;
+}
+void CDynamicResolution::resize(int w, int h)
+{
+    iWidth=qMax(1,w);
+    iHeight=qMax(1,h);
+    deleteFramebuffer();
+}
+void CDynamicResolution::setEnabled(bool enabled)
+{
+    bEnabled=enabled; //the framebuffer is released in the next beginFrame() where a context is current
+}
+void CDynamicResolution::setScaleRange(float minScale, float maxScale)
+{
+    fMinScale=qBound(0.05f,minScale,1.0f);
+    fMaxScale=qBound(fMinScale,maxScale,1.0f);
+    fScale=qBound(fMinScale,fScale,fMaxScale);
+}
+QSize CDynamicResolution::renderSize() const
+{
+    return QSize(qMax(1,qRound(iWidth*scale())),qMax(1,qRound(iHeight*scale())));
+}
+
+void CDynamicResolution::beginFrame()
+{
+    if (timer.poll())
+    {
+        dSmoothedMS = dSmoothedMS>0.0 ? 0.9*dSmoothedMS+0.1*timer.lastMS() : timer.lastMS();
+        if (bEnabled)
+            updateController();
+    }
+    timer.begin();
+    if (!bEnabled)
+    {
+        deleteFramebuffer();
+        return;
+    }
+    //the framebuffer is allocated at full size once, scaled frames only use its lower left part;
+    //depth and stencil are packed like in the widget framebuffer, so depth can be blitted between them
+    if (!fbo)
+        fbo = new QOpenGLFramebufferObject(iWidth,iHeight,QOpenGLFramebufferObject::CombinedDepthStencil);
+    fbo->bind();
+    QSize size=renderSize();
+    gl->glViewport(0,0,size.width(),size.height());
+}
+void CDynamicResolution::endFrame(GLuint targetFramebuffer)
+{
+    timer.end();
+    if (!bEnabled || !fbo)
+        return;
+    QSize size=renderSize();
+    gl->glBindFramebuffer(GL_READ_FRAMEBUFFER,fbo->handle());
+    gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER,targetFramebuffer);
+    gl->glBlitFramebuffer(0,0,size.width(),size.height(),0,0,iWidth,iHeight,GL_COLOR_BUFFER_BIT,GL_LINEAR);
+    gl->glBindFramebuffer(GL_FRAMEBUFFER,targetFramebuffer);
+    gl->glViewport(0,0,iWidth,iHeight);
+}
+
+void CDynamicResolution::updateController()
+{
+    //fill cost scales with the pixel count, i.e. with the square of the scale
+    double dRatio=dTargetMS/qMax(0.01,dSmoothedMS);
+    if (dRatio>0.95 && dRatio<1.05) //close enough, avoid oscillating around the target
+        return;
+    float fDesired=fScale*(float)qSqrt(dRatio);
+    fScale+=(fDesired-fScale)*0.25f;
+    fScale=qBound(fMinScale,fScale,fMaxScale);
+}
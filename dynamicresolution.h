@@ -0,0 +1,51 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include "gputimer.h"
+
+#include <GL/gl.h>
+#include <QtCore>
+
+class CGLTraceFunctions;
+class QOpenGLFramebufferObject;
+
+
+// Renders the scene into an offscreen framebuffer at a fraction of the widget
+// resolution and upscales it. The fraction follows the measured GPU frame time
+// so that it stays close to a configurable target.
+class CDynamicResolution
+{
+public:
+    CDynamicResolution();
+    ~CDynamicResolution();
+    bool initialize(CGLTraceFunctions *);
+    void deleteFramebuffer();
+    void resize(int w, int h);
+    void beginFrame();
+    void endFrame(GLuint targetFramebuffer);
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const {return bEnabled;}
+    void setTargetFrameTime(double ms) {dTargetMS=qMax(0.5,ms);}
+    double targetFrameTime() const {return dTargetMS;}
+    void setScaleRange(float minScale, float maxScale);
+    float scale() const {return bEnabled?fScale:1.0f;}
+    double frameTime() const {return dSmoothedMS;}
+    QSize renderSize() const;
+
+protected:
+    void updateController();
+    bool bEnabled=false;
+    float fScale=1.0f;
+    float fMinScale=0.25f;
+    float fMaxScale=1.0f;
+    double dTargetMS=16.0;
+    double dSmoothedMS=0.0;
+    int iWidth=1;
+    int iHeight=1;
+    CGpuTimer timer;
+    QOpenGLFramebufferObject *fbo=0;
+    CGLTraceFunctions* gl = 0;
+};
+
+#endif // DYNAMICRESOLUTION_H
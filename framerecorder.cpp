@@ -0,0 +1,219 @@
+#include "framerecorder.h"
+
+#include <QOpenGLFunctions_4_0_Core>
+#include <QImage>
+#include <cstring>
+
+
+// Encodes and writes one frame on a pool thread
+class CFrameWriteTask : public QRunnable
+{
+public:
+    CFrameWriteTask(CFrameRecorder *recorder, const QByteArray &pixels, int width, int height, int frame)
+        :recorder(recorder),pixels(pixels),iWidth(width),iHeight(height),iFrame(frame) {}
+    void run()
+    {
+        qint64 iBytes=0;
+        if (recorder->eFormat==CFrameRecorder::PngSequence)
+        {
+            //rows are bottom up in GL, the alpha of the default framebuffer is not meaningful
+            QImage image(reinterpret_cast<const uchar*>(pixels.constData()),iWidth,iHeight,iWidth*4,QImage::Format_RGBA8888);
+            QString qstrFile=QString("%1/frame_%2.png").arg(recorder->qstrDirectory).arg(iFrame,6,10,QChar('0'));
+            if (image.convertToFormat(QImage::Format_RGB888).mirrored().save(qstrFile))
+                iBytes=QFileInfo(qstrFile).size();
+            else
+                qDebug() << "Writing" << qstrFile << "failed";
+        }
+        else
+        {
+            //the raw stream has a single writer thread, so frames arrive in order
+            QDataStream stream(&recorder->rawFile);
+            stream << (qint32)iFrame << (qint32)iWidth << (qint32)iHeight;
+            stream.writeRawData(pixels.constData(),pixels.size());
+            iBytes=3*sizeof(qint32)+pixels.size();
+        }
+        recorder->iWrittenBytes.fetchAndAddRelaxed(iBytes);
+        recorder->iWrittenFrames.fetchAndAddRelaxed(1);
+        recorder->iPendingWrites.fetchAndAddRelaxed(-1);
+    }
+protected:
+    CFrameRecorder *recorder;
+    QByteArray pixels;
+    int iWidth, iHeight, iFrame;
+};
+
+
+CFrameRecorder::CFrameRecorder()
+    :iPendingWrites(0),iWrittenFrames(0),iWrittenBytes(0)
+{
+    for (int i=0;i<NumBuffers;i++)
+    {
+        Slots[i].buffer=0;
+        Slots[i].fence=0;
+        Slots[i].size=0;
+    }
+}
+CFrameRecorder::~CFrameRecorder()
+{
+    stop();
+    deleteBuffers();
+}
+bool CFrameRecorder::initialize(QOpenGLFunctions_4_0_Core *functions)
+{
+    gl=functions;
+    if (!gl)
+    {
+        qDebug() << "OpenGLFunctions not initialized or not supported";
+        return false;
+    }
+    return true;
+}
+void CFrameRecorder::deleteBuffers()
+{
+    if (!gl)
+        return;
+    for (int i=0;i<NumBuffers;i++)
+    {
+        if (Slots[i].fence)
+            gl->glDeleteSync(Slots[i].fence);
+        if (Slots[i].buffer)
+            gl->glDeleteBuffers(1,&Slots[i].buffer);
+        Slots[i].buffer=0;
+        Slots[i].fence=0;
+        Slots[i].size=0;
+    }
+}
+
+bool CFrameRecorder::start(const QString &directory, Format format)
+{
+    if (!gl)
+        return false;
+    stop();
+    if (!QDir().mkpath(directory))
+    {
+        qDebug() << "Could not create capture directory" << directory;
+        return false;
+    }
+    qstrDirectory=directory;
+    eFormat=format;
+    if (eFormat==RawStream)
+    {
+        rawFile.setFileName(directory+"/frames.raw");
+        if (!rawFile.open(QIODevice::WriteOnly))
+        {
+            qDebug() << "Could not open" << rawFile.fileName();
+            return false;
+        }
+        //header: magic, version, pixel format; then per frame index, width, height and RGBA rows bottom up
+        QDataStream stream(&rawFile);
+        stream << (quint32)0x57415246 << (quint32)1 << (quint32)GL_RGBA;
+        writers.setMaxThreadCount(1);
+    }
+    else
+        writers.setMaxThreadCount(qMax(1,QThread::idealThreadCount()-1));
+    iFrame=iCaptured=iDropped=0;
+    iWrittenFrames.store(0);
+    iWrittenBytes.store(0);
+    iRecordMS=0;
+    recordTimer.start();
+    bRecording=true;
+    return true;
+}
+void CFrameRecorder::stop()
+{
+    if (!bRecording)
+        return;
+    //frames still in flight are waited for here, this is the only place the recorder blocks
+    collect(true);
+    writers.waitForDone();
+    iRecordMS=recordTimer.elapsed();
+    if (rawFile.isOpen())
+        rawFile.close();
+    bRecording=false;
+    qDebug() << statistics();
+}
+
+void CFrameRecorder::captureFrame(GLuint framebuffer, int width, int height)
+{
+    if (!bRecording || width<=0 || height<=0)
+        return;
+    iFrame++;
+    collect(false);
+    SSlot &slot=Slots[iNext];
+    if (slot.fence || iPendingWrites.load()>=MaxPendingWrites)
+    {
+        //the readback or the writers can't keep up, waiting would stall rendering
+        iDropped++;
+        return;
+    }
+    GLsizeiptr iSize=(GLsizeiptr)width*height*4;
+    if (!slot.buffer)
+        gl->glGenBuffers(1,&slot.buffer);
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER,slot.buffer);
+    if (slot.size!=iSize)
+    {
+        gl->glBufferData(GL_PIXEL_PACK_BUFFER,iSize,NULL,GL_STREAM_READ);
+        slot.size=iSize;
+    }
+    gl->glBindFramebuffer(GL_READ_FRAMEBUFFER,framebuffer);
+    gl->glPixelStorei(GL_PACK_ALIGNMENT,4);
+    gl->glReadPixels(0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,0);
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+    slot.fence=gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+    slot.width=width;
+    slot.height=height;
+    slot.frame=iFrame;
+    iNext=(iNext+1)%NumBuffers;
+    iCaptured++;
+}
+
+// Hands every finished readback to the writers, oldest first
+void CFrameRecorder::collect(bool wait)
+{
+    for (int i=0;i<NumBuffers;i++)
+    {
+        SSlot &slot=Slots[(iNext+i)%NumBuffers];
+        if (!slot.fence)
+            continue;
+        GLenum eResult=gl->glClientWaitSync(slot.fence,wait?GL_SYNC_FLUSH_COMMANDS_BIT:0,wait?GLuint64(1000000000):0);
+        if (eResult==GL_TIMEOUT_EXPIRED)
+            continue;
+        if (eResult==GL_WAIT_FAILED)
+            qDebug() << "Waiting for frame readback fence failed";
+        gl->glDeleteSync(slot.fence);
+        slot.fence=0;
+        writeFrame(slot);
+    }
+}
+void CFrameRecorder::writeFrame(SSlot &slot)
+{
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER,slot.buffer);
+    void *mapped=gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER,0,slot.size,GL_MAP_READ_BIT);
+    if (mapped)
+    {
+        QByteArray pixels(static_cast<const char*>(mapped),slot.size);
+        gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        iPendingWrites.fetchAndAddRelaxed(1);
+        writers.start(new CFrameWriteTask(this,pixels,slot.width,slot.height,slot.frame));
+    }
+    else
+        qDebug() << "Mapping frame readback buffer failed";
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+}
+
+double CFrameRecorder::throughputMBs() const
+{
+    qint64 iMS=bRecording?recordTimer.elapsed():iRecordMS;
+    return iMS>0?iWrittenBytes.load()/1048576.0/(iMS/1000.0):0.0;
+}
+double CFrameRecorder::framesPerSecond() const
+{
+    qint64 iMS=bRecording?recordTimer.elapsed():iRecordMS;
+    return iMS>0?iWrittenFrames.load()/(iMS/1000.0):0.0;
+}
+QString CFrameRecorder::statistics() const
+{
+    return QString("Recording %1: %2 frames captured, %3 dropped, %4 written (%5 fps, %6 MB/s)")
+            .arg(qstrDirectory).arg(iCaptured).arg(iDropped).arg(writtenFrames())
+            .arg(framesPerSecond(),0,'f',1).arg(throughputMBs(),0,'f',1);
+}
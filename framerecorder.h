@@ -0,0 +1,73 @@
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <GL/gl.h>
+#include <qopengl.h>
+#include <QtCore>
+
+class QOpenGLFunctions_4_0_Core;
+
+
+// Records rendered frames to disk without stalling the pipeline. Every frame
+// is read into one of NumBuffers pixel pack buffers with glReadPixels, which
+// only queues the copy; the buffer is mapped a few frames later, once its
+// fence has signaled. Encoding and writing run on a thread pool. If no
+// buffer is free or the writers fall behind, the frame is dropped instead of
+// waiting. Calls go through the plain 4.0 functions so readbacks never end up
+// in a GL trace, and the recorder works with any framebuffer, including the
+// one of a headless replay.
+class CFrameRecorder
+{
+public:
+    enum Format { PngSequence, RawStream };
+    CFrameRecorder();
+    ~CFrameRecorder();
+    bool initialize(QOpenGLFunctions_4_0_Core *);
+    void deleteBuffers();
+    bool start(const QString &directory, Format format=PngSequence);
+    void stop();
+    void captureFrame(GLuint framebuffer, int width, int height);
+
+    bool isRecording() const {return bRecording;}
+    QString directory() const {return qstrDirectory;}
+    int capturedFrames() const {return iCaptured;}
+    int droppedFrames() const {return iDropped;}
+    int writtenFrames() const {return iWrittenFrames.load();}
+    qint64 writtenBytes() const {return iWrittenBytes.load();}
+    double throughputMBs() const;
+    double framesPerSecond() const;
+    QString statistics() const;
+protected:
+    enum { NumBuffers = 3, MaxPendingWrites = 8 };
+    struct SSlot
+    {
+        GLuint buffer;
+        GLsync fence;
+        GLsizeiptr size;
+        int width, height;
+        int frame;
+    };
+    void collect(bool wait);
+    void writeFrame(SSlot &slot);
+
+    SSlot Slots[NumBuffers];
+    int iNext=0;
+    bool bRecording=false;
+    Format eFormat=PngSequence;
+    QString qstrDirectory;
+    QFile rawFile;
+    QThreadPool writers;
+    QElapsedTimer recordTimer;
+    qint64 iRecordMS=0;
+    int iFrame=0;
+    int iCaptured=0;
+    int iDropped=0;
+    QAtomicInt iPendingWrites;
+    QAtomicInt iWrittenFrames;
+    QAtomicInteger<qint64> iWrittenBytes;
+    QOpenGLFunctions_4_0_Core* gl = 0;
+
+    friend class CFrameWriteTask;
+};
+
+#endif // FRAMERECORDER_H
@@ -0,0 +1,472 @@
+#include "gltrace.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QFile>
+
+
+bool CGLTraceFunctions::bRecording=false;
+int CGLTraceFunctions::iCalls=0;
+QByteArray CGLTraceFunctions::traceData;
+QDataStream *CGLTraceFunctions::traceStream=0;
+QSet<GLuint> CGLTraceFunctions::liveBuffers;
+QSet<GLuint> CGLTraceFunctions::liveVertexArrays;
+QSet<GLuint> CGLTraceFunctions::liveQueries;
+QSet<GLuint> CGLTraceFunctions::tracedPrograms;
+QHash<GLuint,qint64> CGLTraceFunctions::bufferSizes;
+QHash<GLenum,GLuint> CGLTraceFunctions::boundBuffers;
+qint64 CGLTraceFunctions::iBufferBytes=0;
+
+static QHash<QOpenGLContext*,CGLTraceFunctions*> contextFunctions;
+
+const char *CGLTraceFunctions::opcodeName(int opcode)
+{
+    static const char *names[NumOpcodes] = {"",
+        "FrameBegin",
+        "glGenBuffers","glDeleteBuffers","glGenVertexArrays","glDeleteVertexArrays","glGenQueries","glDeleteQueries",
+        "glBindBuffer","glBindBufferRange","glBufferData","glBufferSubData","glMapBufferRange",
+        "glBindVertexArray","glVertexAttribPointer","glEnableVertexAttribArray",
+        "glEnable","glDisable","glCullFace","glPolygonMode","glColorMask","glDepthMask","glClear","glClearColor","glViewport","glPatchParameteri",
+        "glDrawArrays","glDrawElements",
+        "glBeginQuery","glEndQuery","glBeginConditionalRender","glEndConditionalRender",
+        "DefineProgram","glUseProgram",
+        "glUniform1i","glUniform1f","glUniform2f","glUniform3f","glUniform3fv","glUniformMatrix4fv"};
+    if (opcode<=0 || opcode>=NumOpcodes)
+        return "unknown";
+    return names[opcode];
+}
+
+CGLTraceFunctions *CGLTraceFunctions::currentContextFunctions()
+{
+    QOpenGLContext *context=QOpenGLContext::currentContext();
+    if (!context)
+        return 0;
+    CGLTraceFunctions *functions=contextFunctions.value(context,0);
+    if (functions)
+        return functions;
+    functions=new CGLTraceFunctions;
+    if (!functions->initializeOpenGLFunctions())
+    {
+        delete functions;
+        return 0;
+    }
+    contextFunctions.insert(context,functions);
+    QObject::connect(context,&QOpenGLContext::aboutToBeDestroyed,[context](){delete contextFunctions.take(context);});
+    return functions;
+}
+
+QDataStream &CGLTraceFunctions::record(Opcode opcode)
+{
+    iCalls++;
+    *traceStream << (quint8)opcode;
+    return *traceStream;
+}
+void CGLTraceFunctions::recordBytes(const void *data, qint64 size)
+{
+    *traceStream << (quint32)size;
+    traceStream->writeRawData(static_cast<const char*>(data),(int)size);
+}
+
+bool CGLTraceFunctions::beginCapture(int width, int height)
+{
+    if (bRecording)
+        return false;
+    traceData.clear();
+    delete traceStream;
+    traceStream=new QDataStream(&traceData,QIODevice::WriteOnly);
+    traceStream->setByteOrder(QDataStream::LittleEndian);
+    traceStream->setFloatingPointPrecision(QDataStream::SinglePrecision);
+    *traceStream << uiMagic << uiVersion << (qint32)width << (qint32)height;
+    iCalls=0;
+    tracedPrograms.clear();
+    bRecording=true;
+    snapshotResources();
+    record(FrameBegin);
+    return true;
+}
+bool CGLTraceFunctions::endCapture(const QString &fileName)
+{
+    if (!bRecording)
+        return false;
+    bRecording=false;
+    delete traceStream;
+    traceStream=0;
+    QFile file(fileName);
+    bool bOk=file.open(QIODevice::WriteOnly) && file.write(traceData)==traceData.size();
+    if (!bOk)
+        qDebug() << "Could not write GL trace" << fileName;
+    traceData.clear();
+    return bOk;
+}
+
+//records the buffers and vertex arrays that exist before the captured frame, so the trace replays on its own
+void CGLTraceFunctions::snapshotResources()
+{
+    GLint iArrayBuffer=0, iVertexArray=0;
+    QOpenGLFunctions_4_0_Core::glGetIntegerv(GL_ARRAY_BUFFER_BINDING,&iArrayBuffer);
+    QOpenGLFunctions_4_0_Core::glGetIntegerv(GL_VERTEX_ARRAY_BINDING,&iVertexArray);
+    QOpenGLFunctions_4_0_Core::glBindVertexArray(0);
+    foreach (GLuint uiBuffer, liveBuffers)
+    {
+        record(GenBuffer) << (quint32)uiBuffer;
+        QOpenGLFunctions_4_0_Core::glBindBuffer(GL_COPY_READ_BUFFER,uiBuffer);
+        GLint iSize=0, iUsage=GL_STATIC_DRAW;
+        QOpenGLFunctions_4_0_Core::glGetBufferParameteriv(GL_COPY_READ_BUFFER,GL_BUFFER_SIZE,&iSize);
+        QOpenGLFunctions_4_0_Core::glGetBufferParameteriv(GL_COPY_READ_BUFFER,GL_BUFFER_USAGE,&iUsage);
+        QByteArray contents(iSize,0);
+        if (iSize>0)
+            QOpenGLFunctions_4_0_Core::glGetBufferSubData(GL_COPY_READ_BUFFER,0,iSize,contents.data());
+        record(BindBuffer) << (quint32)GL_COPY_READ_BUFFER << (quint32)uiBuffer;
+        record(BufferData) << (quint32)GL_COPY_READ_BUFFER << (quint32)iUsage << (quint8)1;
+        recordBytes(contents.constData(),contents.size());
+    }
+    QOpenGLFunctions_4_0_Core::glBindBuffer(GL_COPY_READ_BUFFER,0);
+    record(BindBuffer) << (quint32)GL_COPY_READ_BUFFER << (quint32)0;
+    foreach (GLuint uiQuery, liveQueries)
+        record(GenQuery) << (quint32)uiQuery;
+
+    GLint iMaxAttribs=0;
+    QOpenGLFunctions_4_0_Core::glGetIntegerv(GL_MAX_VERTEX_ATTRIBS,&iMaxAttribs);
+    foreach (GLuint uiVertexArray, liveVertexArrays)
+    {
+        record(GenVertexArray) << (quint32)uiVertexArray;
+        record(BindVertexArray) << (quint32)uiVertexArray;
+        QOpenGLFunctions_4_0_Core::glBindVertexArray(uiVertexArray);
+        for (int i=0;i<iMaxAttribs;i++)
+        {
+            GLint iEnabled=0, iSize=4, iType=GL_FLOAT, iNormalized=0, iStride=0, iBuffer=0;
+            GLvoid *pointer=0;
+            QOpenGLFunctions_4_0_Core::glGetVertexAttribiv(i,GL_VERTEX_ATTRIB_ARRAY_ENABLED,&iEnabled);
+            if (!iEnabled)
+                continue;
+            QOpenGLFunctions_4_0_Core::glGetVertexAttribiv(i,GL_VERTEX_ATTRIB_ARRAY_SIZE,&iSize);
+            QOpenGLFunctions_4_0_Core::glGetVertexAttribiv(i,GL_VERTEX_ATTRIB_ARRAY_TYPE,&iType);
+            QOpenGLFunctions_4_0_Core::glGetVertexAttribiv(i,GL_VERTEX_ATTRIB_ARRAY_NORMALIZED,&iNormalized);
+            QOpenGLFunctions_4_0_Core::glGetVertexAttribiv(i,GL_VERTEX_ATTRIB_ARRAY_STRIDE,&iStride);
+            QOpenGLFunctions_4_0_Core::glGetVertexAttribiv(i,GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING,&iBuffer);
+            QOpenGLFunctions_4_0_Core::glGetVertexAttribPointerv(i,GL_VERTEX_ATTRIB_ARRAY_POINTER,&pointer);
+            record(BindBuffer) << (quint32)GL_ARRAY_BUFFER << (quint32)iBuffer;
+            record(VertexAttribPointer) << (quint32)i << (qint32)iSize << (quint32)iType << (quint8)iNormalized
+                                        << (qint32)iStride << (quint64)reinterpret_cast<quintptr>(pointer);
+            record(EnableVertexAttribArray) << (quint32)i;
+        }
+        GLint iElementBuffer=0;
+        QOpenGLFunctions_4_0_Core::glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING,&iElementBuffer);
+        record(BindBuffer) << (quint32)GL_ELEMENT_ARRAY_BUFFER << (quint32)iElementBuffer;
+    }
+    record(BindVertexArray) << (quint32)0;
+    record(BindBuffer) << (quint32)GL_ARRAY_BUFFER << (quint32)0;
+    QOpenGLFunctions_4_0_Core::glBindVertexArray(iVertexArray);
+    QOpenGLFunctions_4_0_Core::glBindBuffer(GL_ARRAY_BUFFER,iArrayBuffer);
+}
+
+//programs are recorded with their sources, uniform locations and block bindings the first time they are used
+void CGLTraceFunctions::traceProgram(QOpenGLShaderProgram *program)
+{
+    if (!bRecording)
+        return;
+    GLuint uiProgram=program?program->programId():0;
+    if (uiProgram && !tracedPrograms.contains(uiProgram))
+    {
+        tracedPrograms.insert(uiProgram);
+        QList<QOpenGLShader*> shaders=program->shaders();
+        record(DefineProgram) << (quint32)uiProgram << (quint32)shaders.size();
+        foreach (QOpenGLShader *shader, shaders)
+            *traceStream << (quint32)shader->shaderType() << shader->sourceCode();
+        char name[256];
+        GLint iUniforms=0;
+        QOpenGLFunctions_4_0_Core::glGetProgramiv(uiProgram,GL_ACTIVE_UNIFORMS,&iUniforms);
+        *traceStream << (quint32)iUniforms;
+        for (int i=0;i<iUniforms;i++)
+        {
+            GLsizei iLength=0;
+            GLint iSize=0;
+            GLenum eType=0;
+            QOpenGLFunctions_4_0_Core::glGetActiveUniform(uiProgram,i,sizeof(name),&iLength,&iSize,&eType,name);
+            *traceStream << QByteArray(name,iLength) << (qint32)QOpenGLFunctions_4_0_Core::glGetUniformLocation(uiProgram,name);
+        }
+        GLint iBlocks=0;
+        QOpenGLFunctions_4_0_Core::glGetProgramiv(uiProgram,GL_ACTIVE_UNIFORM_BLOCKS,&iBlocks);
+        *traceStream << (quint32)iBlocks;
+        for (int i=0;i<iBlocks;i++)
+        {
+            GLsizei iLength=0;
+            GLint iBinding=0;
+            QOpenGLFunctions_4_0_Core::glGetActiveUniformBlockName(uiProgram,i,sizeof(name),&iLength,name);
+            QOpenGLFunctions_4_0_Core::glGetActiveUniformBlockiv(uiProgram,i,GL_UNIFORM_BLOCK_BINDING,&iBinding);
+            *traceStream << QByteArray(name,iLength) << (qint32)iBinding;
+        }
+    }
+    record(UseProgram) << (quint32)uiProgram;
+}
+
+
+void CGLTraceFunctions::glGenBuffers(GLsizei n, GLuint *buffers)
+{
+    QOpenGLFunctions_4_0_Core::glGenBuffers(n,buffers);
+    for (int i=0;i<n;i++)
+    {
+        liveBuffers.insert(buffers[i]);
+        if (bRecording)
+            record(GenBuffer) << (quint32)buffers[i];
+    }
+}
+void CGLTraceFunctions::glDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+    for (int i=0;i<n;i++)
+    {
+        liveBuffers.remove(buffers[i]);
+        iBufferBytes-=bufferSizes.take(buffers[i]);
+        for (QHash<GLenum,GLuint>::iterator it=boundBuffers.begin();it!=boundBuffers.end();++it)
+            if (it.value()==buffers[i])
+                it.value()=0;
+        if (bRecording)
+            record(DeleteBuffer) << (quint32)buffers[i];
+    }
+    QOpenGLFunctions_4_0_Core::glDeleteBuffers(n,buffers);
+}
+void CGLTraceFunctions::glBindBuffer(GLenum target, GLuint buffer)
+{
+    boundBuffers.insert(target,buffer);
+    if (bRecording)
+        record(BindBuffer) << (quint32)target << (quint32)buffer;
+    QOpenGLFunctions_4_0_Core::glBindBuffer(target,buffer);
+}
+void CGLTraceFunctions::glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    if (bRecording)
+        record(BindBufferRange) << (quint32)target << (quint32)index << (quint32)buffer << (qint64)offset << (qint64)size;
+    QOpenGLFunctions_4_0_Core::glBindBufferRange(target,index,buffer,offset,size);
+}
+void CGLTraceFunctions::glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage)
+{
+    GLuint uiBuffer=boundBuffers.value(target,0);
+    if (uiBuffer)
+    {
+        iBufferBytes+=size-bufferSizes.value(uiBuffer,0);
+        bufferSizes.insert(uiBuffer,size);
+    }
+    if (bRecording)
+    {
+        record(BufferData) << (quint32)target << (quint32)usage << (quint8)(data!=0);
+        if (data)
+            recordBytes(data,size);
+        else
+            *traceStream << (quint32)size;
+    }
+    QOpenGLFunctions_4_0_Core::glBufferData(target,size,data,usage);
+}
+void CGLTraceFunctions::glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data)
+{
+    if (bRecording)
+    {
+        record(BufferSubData) << (quint32)target << (qint64)offset;
+        recordBytes(data,size);
+    }
+    QOpenGLFunctions_4_0_Core::glBufferSubData(target,offset,size,data);
+}
+//mapped ranges are write only, so the writer hands in its CPU copy of what it wrote instead of the trace reading the mapping
+void CGLTraceFunctions::traceMappedWrite(GLenum target, GLintptr offset, const void *data, GLsizeiptr size)
+{
+    if (!bRecording)
+        return;
+    record(MapBufferWrite) << (quint32)target << (qint64)offset;
+    recordBytes(data,size);
+}
+void CGLTraceFunctions::glGenVertexArrays(GLsizei n, GLuint *arrays)
+{
+    QOpenGLFunctions_4_0_Core::glGenVertexArrays(n,arrays);
+    for (int i=0;i<n;i++)
+    {
+        liveVertexArrays.insert(arrays[i]);
+        if (bRecording)
+            record(GenVertexArray) << (quint32)arrays[i];
+    }
+}
+void CGLTraceFunctions::glDeleteVertexArrays(GLsizei n, const GLuint *arrays)
+{
+    for (int i=0;i<n;i++)
+    {
+        liveVertexArrays.remove(arrays[i]);
+        if (bRecording)
+            record(DeleteVertexArray) << (quint32)arrays[i];
+    }
+    QOpenGLFunctions_4_0_Core::glDeleteVertexArrays(n,arrays);
+}
+void CGLTraceFunctions::glBindVertexArray(GLuint array)
+{
+    if (bRecording)
+        record(BindVertexArray) << (quint32)array;
+    QOpenGLFunctions_4_0_Core::glBindVertexArray(array);
+}
+void CGLTraceFunctions::glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer)
+{
+    if (bRecording)
+        record(VertexAttribPointer) << (quint32)index << (qint32)size << (quint32)type << (quint8)normalized
+                                    << (qint32)stride << (quint64)reinterpret_cast<quintptr>(pointer);
+    QOpenGLFunctions_4_0_Core::glVertexAttribPointer(index,size,type,normalized,stride,pointer);
+}
+void CGLTraceFunctions::glEnableVertexAttribArray(GLuint index)
+{
+    if (bRecording)
+        record(EnableVertexAttribArray) << (quint32)index;
+    QOpenGLFunctions_4_0_Core::glEnableVertexAttribArray(index);
+}
+void CGLTraceFunctions::glEnable(GLenum cap)
+{
+    if (bRecording)
+        record(Enable) << (quint32)cap;
+    QOpenGLFunctions_4_0_Core::glEnable(cap);
+}
+void CGLTraceFunctions::glDisable(GLenum cap)
+{
+    if (bRecording)
+        record(Disable) << (quint32)cap;
+    QOpenGLFunctions_4_0_Core::glDisable(cap);
+}
+void CGLTraceFunctions::glCullFace(GLenum mode)
+{
+    if (bRecording)
+        record(CullFace) << (quint32)mode;
+    QOpenGLFunctions_4_0_Core::glCullFace(mode);
+}
+void CGLTraceFunctions::glPolygonMode(GLenum face, GLenum mode)
+{
+    if (bRecording)
+        record(PolygonMode) << (quint32)face << (quint32)mode;
+    QOpenGLFunctions_4_0_Core::glPolygonMode(face,mode);
+}
+void CGLTraceFunctions::glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    if (bRecording)
+        record(ColorMask) << (quint8)red << (quint8)green << (quint8)blue << (quint8)alpha;
+    QOpenGLFunctions_4_0_Core::glColorMask(red,green,blue,alpha);
+}
+void CGLTraceFunctions::glDepthMask(GLboolean flag)
+{
+    if (bRecording)
+        record(DepthMask) << (quint8)flag;
+    QOpenGLFunctions_4_0_Core::glDepthMask(flag);
+}
+void CGLTraceFunctions::glClear(GLbitfield mask)
+{
+    if (bRecording)
+        record(Clear) << (quint32)mask;
+    QOpenGLFunctions_4_0_Core::glClear(mask);
+}
+void CGLTraceFunctions::glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    if (bRecording)
+        record(ClearColor) << red << green << blue << alpha;
+    QOpenGLFunctions_4_0_Core::glClearColor(red,green,blue,alpha);
+}
+void CGLTraceFunctions::glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (bRecording)
+        record(Viewport) << (qint32)x << (qint32)y << (qint32)width << (qint32)height;
+    QOpenGLFunctions_4_0_Core::glViewport(x,y,width,height);
+}
+void CGLTraceFunctions::glPatchParameteri(GLenum pname, GLint value)
+{
+    if (bRecording)
+        record(PatchParameteri) << (quint32)pname << (qint32)value;
+    QOpenGLFunctions_4_0_Core::glPatchParameteri(pname,value);
+}
+void CGLTraceFunctions::glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    if (bRecording)
+        record(DrawArrays) << (quint32)mode << (qint32)first << (qint32)count;
+    QOpenGLFunctions_4_0_Core::glDrawArrays(mode,first,count);
+}
+void CGLTraceFunctions::glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+{
+    if (bRecording)
+        record(DrawElements) << (quint32)mode << (qint32)count << (quint32)type << (quint64)reinterpret_cast<quintptr>(indices);
+    QOpenGLFunctions_4_0_Core::glDrawElements(mode,count,type,indices);
+}
+void CGLTraceFunctions::glGenQueries(GLsizei n, GLuint *ids)
+{
+    QOpenGLFunctions_4_0_Core::glGenQueries(n,ids);
+    for (int i=0;i<n;i++)
+    {
+        liveQueries.insert(ids[i]);
+        if (bRecording)
+            record(GenQuery) << (quint32)ids[i];
+    }
+}
+void CGLTraceFunctions::glDeleteQueries(GLsizei n, const GLuint *ids)
+{
+    for (int i=0;i<n;i++)
+    {
+        liveQueries.remove(ids[i]);
+        if (bRecording)
+            record(DeleteQuery) << (quint32)ids[i];
+    }
+    QOpenGLFunctions_4_0_Core::glDeleteQueries(n,ids);
+}
+void CGLTraceFunctions::glBeginQuery(GLenum target, GLuint id)
+{
+    if (bRecording)
+        record(BeginQuery) << (quint32)target << (quint32)id;
+    QOpenGLFunctions_4_0_Core::glBeginQuery(target,id);
+}
+void CGLTraceFunctions::glEndQuery(GLenum target)
+{
+    if (bRecording)
+        record(EndQuery) << (quint32)target;
+    QOpenGLFunctions_4_0_Core::glEndQuery(target);
+}
+void CGLTraceFunctions::glBeginConditionalRender(GLuint id, GLenum mode)
+{
+    if (bRecording)
+        record(BeginConditionalRender) << (quint32)id << (quint32)mode;
+    QOpenGLFunctions_4_0_Core::glBeginConditionalRender(id,mode);
+}
+void CGLTraceFunctions::glEndConditionalRender()
+{
+    if (bRecording)
+        record(EndConditionalRender);
+    QOpenGLFunctions_4_0_Core::glEndConditionalRender();
+}
+void CGLTraceFunctions::glUniform1i(GLint location, GLint v0)
+{
+    if (bRecording)
+        record(Uniform1i) << (qint32)location << (qint32)v0;
+    QOpenGLFunctions_4_0_Core::glUniform1i(location,v0);
+}
+void CGLTraceFunctions::glUniform1f(GLint location, GLfloat v0)
+{
+    if (bRecording)
+        record(Uniform1f) << (qint32)location << v0;
+    QOpenGLFunctions_4_0_Core::glUniform1f(location,v0);
+}
+void CGLTraceFunctions::glUniform2f(GLint location, GLfloat v0, GLfloat v1)
+{
+    if (bRecording)
+        record(Uniform2f) << (qint32)location << v0 << v1;
+    QOpenGLFunctions_4_0_Core::glUniform2f(location,v0,v1);
+}
+void CGLTraceFunctions::glUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+    if (bRecording)
+        record(Uniform3f) << (qint32)location << v0 << v1 << v2;
+    QOpenGLFunctions_4_0_Core::glUniform3f(location,v0,v1,v2);
+}
+void CGLTraceFunctions::glUniform3fv(GLint location, GLsizei count, const GLfloat *value)
+{
+    if (bRecording)
+    {
+        record(Uniform3fv) << (qint32)location;
+        recordBytes(value,count*3*sizeof(GLfloat));
+    }
+    QOpenGLFunctions_4_0_Core::glUniform3fv(location,count,value);
+}
+void CGLTraceFunctions::glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+    if (bRecording)
+    {
+        record(UniformMatrix4fv) << (qint32)location << (quint8)transpose;
+        recordBytes(value,count*16*sizeof(GLfloat));
+    }
+    QOpenGLFunctions_4_0_Core::glUniformMatrix4fv(location,count,transpose,value);
+}
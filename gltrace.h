@@ -0,0 +1,98 @@
+#ifndef GLTRACE_H
+#define GLTRACE_H
+
+#include <QOpenGLFunctions_4_0_Core>
+#include <QtCore>
+
+class QOpenGLShaderProgram;
+
+
+// GL functions with a tracing layer. The calls the render objects make are
+// hidden by versions that append them, together with their buffer contents
+// and uniform values, to a binary trace while a capture is running, and then
+// forward to QOpenGLFunctions_4_0_Core. Outside of a capture only the names
+// of live buffers, vertex arrays and queries and the buffer sizes are
+// tracked, so a capture can start with a snapshot of the resources that
+// already exist and the buffer memory in use is known. Writes through mapped
+// buffer ranges are reported by the writer with traceMappedWrite.
+// Trace files are replayed by CGLTraceReplay.
+class CGLTraceFunctions : public QOpenGLFunctions_4_0_Core
+{
+public:
+    enum Opcode {
+        FrameBegin = 1,
+        GenBuffer, DeleteBuffer, GenVertexArray, DeleteVertexArray, GenQuery, DeleteQuery,
+        BindBuffer, BindBufferRange, BufferData, BufferSubData, MapBufferWrite,
+        BindVertexArray, VertexAttribPointer, EnableVertexAttribArray,
+        Enable, Disable, CullFace, PolygonMode, ColorMask, DepthMask, Clear, ClearColor, Viewport, PatchParameteri,
+        DrawArrays, DrawElements,
+        BeginQuery, EndQuery, BeginConditionalRender, EndConditionalRender,
+        DefineProgram, UseProgram,
+        Uniform1i, Uniform1f, Uniform2f, Uniform3f, Uniform3fv, UniformMatrix4fv,
+        NumOpcodes
+    };
+    static const quint32 uiMagic = 0x52544c47; // "GLTR"
+    static const quint32 uiVersion = 1;
+    static const char *opcodeName(int opcode);
+
+    static CGLTraceFunctions *currentContextFunctions();
+    static bool isRecording() {return bRecording;}
+    bool beginCapture(int width, int height);
+    static bool endCapture(const QString &fileName);
+    static int capturedCalls() {return iCalls;}
+    static qint64 bufferBytes() {return iBufferBytes;}
+    void traceProgram(QOpenGLShaderProgram *program);
+    void traceMappedWrite(GLenum target, GLintptr offset, const void *data, GLsizeiptr size);
+
+    void glGenBuffers(GLsizei n, GLuint *buffers);
+    void glDeleteBuffers(GLsizei n, const GLuint *buffers);
+    void glBindBuffer(GLenum target, GLuint buffer);
+    void glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage);
+    void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data);
+    void glGenVertexArrays(GLsizei n, GLuint *arrays);
+    void glDeleteVertexArrays(GLsizei n, const GLuint *arrays);
+    void glBindVertexArray(GLuint array);
+    void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
+    void glEnableVertexAttribArray(GLuint index);
+    void glEnable(GLenum cap);
+    void glDisable(GLenum cap);
+    void glCullFace(GLenum mode);
+    void glPolygonMode(GLenum face, GLenum mode);
+    void glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+    void glDepthMask(GLboolean flag);
+    void glClear(GLbitfield mask);
+    void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+    void glViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void glPatchParameteri(GLenum pname, GLint value);
+    void glDrawArrays(GLenum mode, GLint first, GLsizei count);
+    void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices);
+    void glGenQueries(GLsizei n, GLuint *ids);
+    void glDeleteQueries(GLsizei n, const GLuint *ids);
+    void glBeginQuery(GLenum target, GLuint id);
+    void glEndQuery(GLenum target);
+    void glBeginConditionalRender(GLuint id, GLenum mode);
+    void glEndConditionalRender();
+    void glUniform1i(GLint location, GLint v0);
+    void glUniform1f(GLint location, GLfloat v0);
+    void glUniform2f(GLint location, GLfloat v0, GLfloat v1);
+    void glUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+    void glUniform3fv(GLint location, GLsizei count, const GLfloat *value);
+    void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+
+protected:
+    static QDataStream &record(Opcode opcode);
+    static void recordBytes(const void *data, qint64 size);
+    void snapshotResources();
+
+    static bool bRecording;
+    static int iCalls;
+    static QByteArray traceData;
+    static QDataStream *traceStream;
+    static QSet<GLuint> liveBuffers, liveVertexArrays, liveQueries, tracedPrograms;
+    static QHash<GLuint,qint64> bufferSizes;
+    static QHash<GLenum,GLuint> boundBuffers;
+    static qint64 iBufferBytes;
+};
+
+#endif // GLTRACE_H
@@ -0,0 +1,483 @@
+#include "gltracereplay.h"
+
+#include "framerecorder.h"
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLFramebufferObject>
+#include <QOffscreenSurface>
+#include <QFile>
+#include <cstring>
+
+
+CGLTraceReplay::CGLTraceReplay()
+{}
+CGLTraceReplay::~CGLTraceReplay()
+{
+    qDeleteAll(shaderPrograms);
+}
+
+bool CGLTraceReplay::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "Could not open GL trace" << fileName;
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    quint32 uiMagic=0, uiVersion=0;
+    qint32 iW=0, iH=0;
+    stream >> uiMagic >> uiVersion >> iW >> iH;
+    if (uiMagic!=CGLTraceFunctions::uiMagic || uiVersion!=CGLTraceFunctions::uiVersion)
+    {
+        qDebug() << fileName << "is not a GL trace of version" << CGLTraceFunctions::uiVersion;
+        return false;
+    }
+    iWidth=iW;
+    iHeight=iH;
+    setup.clear();
+    frame.clear();
+    programs.clear();
+    bool bInFrame=false;
+    SCommand command;
+    while (!stream.atEnd())
+    {
+        if (!readCommand(stream,command))
+        {
+            qDebug() << "Corrupt GL trace" << fileName;
+            return false;
+        }
+        if (command.opcode==CGLTraceFunctions::FrameBegin)
+            bInFrame=true;
+        else if (bInFrame)
+            frame.append(command);
+        else
+            setup.append(command);
+    }
+    return true;
+}
+
+bool CGLTraceReplay::readCommand(QDataStream &stream, SCommand &command)
+{
+    quint8 ui8=0;
+    quint32 ui32=0;
+    qint32 i32=0;
+    qint64 i64=0;
+    quint64 ui64=0;
+    float f=0.0f;
+    stream >> command.opcode;
+    memset(command.args,0,sizeof(command.args));
+    command.data.clear();
+    auto readBytes=[&stream,&command](){
+        quint32 uiSize=0;
+        stream >> uiSize;
+        command.data.resize(uiSize);
+        stream.readRawData(command.data.data(),uiSize);
+    };
+    auto readFloat=[&stream,&f](quint64 &arg){
+        stream >> f;
+        memcpy(&arg,&f,sizeof(f));
+    };
+    switch (command.opcode)
+    {
+    case CGLTraceFunctions::FrameBegin:
+    case CGLTraceFunctions::EndConditionalRender:
+        break;
+    case CGLTraceFunctions::GenBuffer: case CGLTraceFunctions::DeleteBuffer:
+    case CGLTraceFunctions::GenVertexArray: case CGLTraceFunctions::DeleteVertexArray:
+    case CGLTraceFunctions::GenQuery: case CGLTraceFunctions::DeleteQuery:
+    case CGLTraceFunctions::BindVertexArray: case CGLTraceFunctions::EnableVertexAttribArray:
+    case CGLTraceFunctions::Enable: case CGLTraceFunctions::Disable: case CGLTraceFunctions::CullFace:
+    case CGLTraceFunctions::Clear: case CGLTraceFunctions::EndQuery: case CGLTraceFunctions::UseProgram:
+        stream >> ui32; command.args[0]=ui32;
+        break;
+    case CGLTraceFunctions::BindBuffer: case CGLTraceFunctions::PolygonMode:
+    case CGLTraceFunctions::BeginQuery: case CGLTraceFunctions::BeginConditionalRender:
+        stream >> ui32; command.args[0]=ui32;
+        stream >> ui32; command.args[1]=ui32;
+        break;
+    case CGLTraceFunctions::PatchParameteri:
+        stream >> ui32; command.args[0]=ui32;
+        stream >> i32; command.args[1]=(quint64)(qint64)i32;
+        break;
+    case CGLTraceFunctions::BindBufferRange:
+        stream >> ui32; command.args[0]=ui32;
+        stream >> ui32; command.args[1]=ui32;
+        stream >> ui32; command.args[2]=ui32;
+        stream >> i64; command.args[3]=(quint64)i64;
+        stream >> i64; command.args[4]=(quint64)i64;
+        break;
+    case CGLTraceFunctions::BufferData:
+        stream >> ui32; command.args[0]=ui32;
+        stream >> ui32; command.args[1]=ui32;
+        stream >> ui8; command.args[2]=ui8;
+        if (ui8)
+        {
+            readBytes();
+            command.args[3]=command.data.size();
+        }
+        else
+        {
+            stream >> ui32; command.args[3]=ui32;
+        }
+        break;
+    case CGLTraceFunctions::BufferSubData: case CGLTraceFunctions::MapBufferWrite:
+        stream >> ui32; command.args[0]=ui32;
+        stream >> i64; command.args[1]=(quint64)i64;
+        readBytes();
+        break;
+    case CGLTraceFunctions::VertexAttribPointer:
+        stream >> ui32; command.args[0]=ui32;
+        stream >> i32; command.args[1]=(quint64)(qint64)i32;
+        stream >> ui32; command.args[2]=ui32;
+        stream >> ui8; command.args[3]=ui8;
+        stream >> i32; command.args[4]=(quint64)(qint64)i32;
+        stream >> ui64; command.args[5]=ui64;
+        break;
+    case CGLTraceFunctions::ColorMask:
+        for (int i=0;i<4;i++)
+        {
+            stream >> ui8; command.args[i]=ui8;
+        }
+        break;
+    case CGLTraceFunctions::DepthMask:
+        stream >> ui8; command.args[0]=ui8;
+        break;
+    case CGLTraceFunctions::ClearColor:
+        for (int i=0;i<4;i++)
+            readFloat(command.args[i]);
+        break;
+    case CGLTraceFunctions::Viewport:
+        for (int i=0;i<4;i++)
+        {
+            stream >> i32; command.args[i]=(quint64)(qint64)i32;
+        }
+        break;
+    case CGLTraceFunctions::DrawArrays:
+        stream >> ui32; command.args[0]=ui32;
+        stream >> i32; command.args[1]=(quint64)(qint64)i32;
+        stream >> i32; command.args[2]=(quint64)(qint64)i32;
+        break;
+    case CGLTraceFunctions::DrawElements:
+        stream >> ui32; command.args[0]=ui32;
+        stream >> i32; command.args[1]=(quint64)(qint64)i32;
+        stream >> ui32; command.args[2]=ui32;
+        stream >> ui64; command.args[3]=ui64;
+        break;
+    case CGLTraceFunctions::DefineProgram:
+    {
+        SProgram program;
+        quint32 uiCount=0;
+        stream >> program.id >> uiCount;
+        for (quint32 i=0;i<uiCount;i++)
+        {
+            QByteArray source;
+            stream >> ui32 >> source;
+            program.shaders.append(qMakePair(ui32,source));
+        }
+        stream >> uiCount;
+        for (quint32 i=0;i<uiCount;i++)
+        {
+            QByteArray name;
+            stream >> name >> i32;
+            program.uniforms.append(qMakePair(name,i32));
+        }
+        stream >> uiCount;
+        for (quint32 i=0;i<uiCount;i++)
+        {
+            QByteArray name;
+            stream >> name >> i32;
+            program.blocks.append(qMakePair(name,i32));
+        }
+        command.args[0]=programs.size();
+        programs.append(program);
+        break;
+    }
+    case CGLTraceFunctions::Uniform1i:
+        stream >> i32; command.args[0]=(quint64)(qint64)i32;
+        stream >> i32; command.args[1]=(quint64)(qint64)i32;
+        break;
+    case CGLTraceFunctions::Uniform1f: case CGLTraceFunctions::Uniform2f: case CGLTraceFunctions::Uniform3f:
+        stream >> i32; command.args[0]=(quint64)(qint64)i32;
+        for (int i=0;i<=command.opcode-CGLTraceFunctions::Uniform1f;i++)
+            readFloat(command.args[i+1]);
+        break;
+    case CGLTraceFunctions::Uniform3fv:
+        stream >> i32; command.args[0]=(quint64)(qint64)i32;
+        readBytes();
+        break;
+    case CGLTraceFunctions::UniformMatrix4fv:
+        stream >> i32; command.args[0]=(quint64)(qint64)i32;
+        stream >> ui8; command.args[1]=ui8;
+        readBytes();
+        break;
+    default:
+        return false;
+    }
+    return stream.status()==QDataStream::Ok;
+}
+
+bool CGLTraceReplay::initialize(QOpenGLFunctions_4_0_Core *functions)
+{
+    gl=functions;
+    return gl!=0;
+}
+
+GLuint CGLTraceReplay::mapped(QHash<GLuint,GLuint> &names, GLuint name, int opcode)
+{
+    if (name==0)
+        return 0;
+    QHash<GLuint,GLuint>::const_iterator it=names.constFind(name);
+    if (it!=names.constEnd())
+        return it.value();
+    //objects created before the capture without being part of the snapshot are created on first use
+    GLuint uiNew=0;
+    if (opcode==CGLTraceFunctions::GenBuffer)
+        gl->glGenBuffers(1,&uiNew);
+    else if (opcode==CGLTraceFunctions::GenVertexArray)
+        gl->glGenVertexArrays(1,&uiNew);
+    else if (opcode==CGLTraceFunctions::GenQuery)
+        gl->glGenQueries(1,&uiNew);
+    names.insert(name,uiNew);
+    return uiNew;
+}
+
+GLint CGLTraceReplay::uniformLocation(GLint location)
+{
+    if (location<0)
+        return location;
+    return uniformLocations.value(uiCurrentProgram).value(location,-1);
+}
+
+float CGLTraceReplay::floatArg(const SCommand &command, int index) const
+{
+    float f;
+    memcpy(&f,&command.args[index],sizeof(f));
+    return f;
+}
+
+void CGLTraceReplay::defineProgram(const SProgram &program)
+{
+    if (shaderPrograms.contains(program.id))
+        return;
+    QOpenGLShaderProgram *shaderProgram=new QOpenGLShaderProgram;
+    for (int i=0;i<program.shaders.size();i++)
+        shaderProgram->addShaderFromSourceCode(QOpenGLShader::ShaderType(program.shaders[i].first),program.shaders[i].second);
+    if (!shaderProgram->link())
+        qDebug() << "Replayed program" << program.id << "does not link:" << shaderProgram->log();
+    GLuint uiProgram=shaderProgram->programId();
+    QHash<GLint,GLint> &locations=uniformLocations[program.id];
+    for (int i=0;i<program.uniforms.size();i++)
+        locations.insert(program.uniforms[i].second,gl->glGetUniformLocation(uiProgram,program.uniforms[i].first.constData()));
+    for (int i=0;i<program.blocks.size();i++)
+    {
+        GLuint uiBlock=gl->glGetUniformBlockIndex(uiProgram,program.blocks[i].first.constData());
+        if (uiBlock!=GL_INVALID_INDEX)
+            gl->glUniformBlockBinding(uiProgram,uiBlock,program.blocks[i].second);
+    }
+    shaderPrograms.insert(program.id,shaderProgram);
+}
+
+void CGLTraceReplay::execute(const SCommand &c)
+{
+    const quint64 *a=c.args;
+    switch (c.opcode)
+    {
+    case CGLTraceFunctions::GenBuffer: mapped(buffers,a[0],c.opcode); break;
+    case CGLTraceFunctions::GenVertexArray: mapped(vertexArrays,a[0],c.opcode); break;
+    case CGLTraceFunctions::GenQuery: mapped(queries,a[0],c.opcode); break;
+    case CGLTraceFunctions::DeleteBuffer:
+    {
+        GLuint uiName=buffers.take(a[0]);
+        gl->glDeleteBuffers(1,&uiName);
+        break;
+    }
+    case CGLTraceFunctions::DeleteVertexArray:
+    {
+        GLuint uiName=vertexArrays.take(a[0]);
+        gl->glDeleteVertexArrays(1,&uiName);
+        break;
+    }
+    case CGLTraceFunctions::DeleteQuery:
+    {
+        GLuint uiName=queries.take(a[0]);
+        gl->glDeleteQueries(1,&uiName);
+        break;
+    }
+    case CGLTraceFunctions::BindBuffer: gl->glBindBuffer(a[0],mapped(buffers,a[1],CGLTraceFunctions::GenBuffer)); break;
+    case CGLTraceFunctions::BindBufferRange:
+        gl->glBindBufferRange(a[0],a[1],mapped(buffers,a[2],CGLTraceFunctions::GenBuffer),(GLintptr)a[3],(GLsizeiptr)a[4]);
+        break;
+    case CGLTraceFunctions::BufferData:
+        gl->glBufferData(a[0],(GLsizeiptr)a[3],a[2]?c.data.constData():0,a[1]);
+        break;
+    case CGLTraceFunctions::BufferSubData:
+        gl->glBufferSubData(a[0],(GLintptr)a[1],c.data.size(),c.data.constData());
+        break;
+    case CGLTraceFunctions::MapBufferWrite:
+    {
+        void *pointer=gl->glMapBufferRange(a[0],(GLintptr)a[1],c.data.size(),GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_RANGE_BIT|GL_MAP_UNSYNCHRONIZED_BIT);
+        if (pointer)
+        {
+            memcpy(pointer,c.data.constData(),c.data.size());
+            gl->glUnmapBuffer(a[0]);
+        }
+        break;
+    }
+    case CGLTraceFunctions::BindVertexArray: gl->glBindVertexArray(mapped(vertexArrays,a[0],CGLTraceFunctions::GenVertexArray)); break;
+    case CGLTraceFunctions::VertexAttribPointer:
+        gl->glVertexAttribPointer(a[0],(GLint)(qint64)a[1],a[2],a[3],(GLsizei)(qint64)a[4],reinterpret_cast<const GLvoid*>((quintptr)a[5]));
+        break;
+    case CGLTraceFunctions::EnableVertexAttribArray: gl->glEnableVertexAttribArray(a[0]); break;
+    case CGLTraceFunctions::Enable: gl->glEnable(a[0]); break;
+    case CGLTraceFunctions::Disable: gl->glDisable(a[0]); break;
+    case CGLTraceFunctions::CullFace: gl->glCullFace(a[0]); break;
+    case CGLTraceFunctions::PolygonMode: gl->glPolygonMode(a[0],a[1]); break;
+    case CGLTraceFunctions::ColorMask: gl->glColorMask(a[0],a[1],a[2],a[3]); break;
+    case CGLTraceFunctions::DepthMask: gl->glDepthMask(a[0]); break;
+    case CGLTraceFunctions::Clear: gl->glClear(a[0]); break;
+    case CGLTraceFunctions::ClearColor: gl->glClearColor(floatArg(c,0),floatArg(c,1),floatArg(c,2),floatArg(c,3)); break;
+    case CGLTraceFunctions::Viewport: gl->glViewport((qint64)a[0],(qint64)a[1],(qint64)a[2],(qint64)a[3]); break;
+    case CGLTraceFunctions::PatchParameteri: gl->glPatchParameteri(a[0],(GLint)(qint64)a[1]); break;
+    case CGLTraceFunctions::DrawArrays: gl->glDrawArrays(a[0],(GLint)(qint64)a[1],(GLsizei)(qint64)a[2]); break;
+    case CGLTraceFunctions::DrawElements:
+        gl->glDrawElements(a[0],(GLsizei)(qint64)a[1],a[2],reinterpret_cast<const GLvoid*>((quintptr)a[3]));
+        break;
+    case CGLTraceFunctions::BeginQuery: gl->glBeginQuery(a[0],mapped(queries,a[1],CGLTraceFunctions::GenQuery)); break;
+    case CGLTraceFunctions::EndQuery: gl->glEndQuery(a[0]); break;
+    case CGLTraceFunctions::BeginConditionalRender: gl->glBeginConditionalRender(mapped(queries,a[0],CGLTraceFunctions::GenQuery),a[1]); break;
+    case CGLTraceFunctions::EndConditionalRender: gl->glEndConditionalRender(); break;
+    case CGLTraceFunctions::DefineProgram: defineProgram(programs[a[0]]); break;
+    case CGLTraceFunctions::UseProgram:
+    {
+        uiCurrentProgram=a[0];
+        QOpenGLShaderProgram *program=shaderPrograms.value(uiCurrentProgram,0);
+        gl->glUseProgram(program?program->programId():0);
+        break;
+    }
+    case CGLTraceFunctions::Uniform1i: gl->glUniform1i(uniformLocation((qint64)a[0]),(GLint)(qint64)a[1]); break;
+    case CGLTraceFunctions::Uniform1f: gl->glUniform1f(uniformLocation((qint64)a[0]),floatArg(c,1)); break;
+    case CGLTraceFunctions::Uniform2f: gl->glUniform2f(uniformLocation((qint64)a[0]),floatArg(c,1),floatArg(c,2)); break;
+    case CGLTraceFunctions::Uniform3f: gl->glUniform3f(uniformLocation((qint64)a[0]),floatArg(c,1),floatArg(c,2),floatArg(c,3)); break;
+    case CGLTraceFunctions::Uniform3fv:
+        gl->glUniform3fv(uniformLocation((qint64)a[0]),c.data.size()/(3*sizeof(GLfloat)),reinterpret_cast<const GLfloat*>(c.data.constData()));
+        break;
+    case CGLTraceFunctions::UniformMatrix4fv:
+        gl->glUniformMatrix4fv(uniformLocation((qint64)a[0]),c.data.size()/(16*sizeof(GLfloat)),a[1],reinterpret_cast<const GLfloat*>(c.data.constData()));
+        break;
+    default:
+        break;
+    }
+}
+
+void CGLTraceReplay::replaySetup()
+{
+    for (int i=0;i<setup.size();i++)
+        execute(setup[i]);
+}
+void CGLTraceReplay::replayFrame()
+{
+    for (int i=0;i<frame.size();i++)
+        execute(frame[i]);
+}
+
+QString CGLTraceReplay::benchmark(int iterations)
+{
+    replaySetup();
+    replayFrame(); //warm up, compiles the programs
+    gl->glFinish();
+    iterations=qMax(1,iterations);
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    for (int i=0;i<iterations;i++)
+        replayFrame();
+    gl->glFinish();
+    double dTotalMS=elapsed.nsecsElapsed()/1.0e6;
+    qint64 iCalls=(qint64)frame.size()*iterations;
+
+    //second pass: CPU time spent inside each call type
+    QVector<qint64> callNanoSeconds(CGLTraceFunctions::NumOpcodes,0);
+    QVector<qint64> callCounts(CGLTraceFunctions::NumOpcodes,0);
+    for (int i=0;i<iterations;i++)
+        for (int j=0;j<frame.size();j++)
+        {
+            const SCommand &command=frame[j];
+            elapsed.restart();
+            execute(command);
+            callNanoSeconds[command.opcode]+=elapsed.nsecsElapsed();
+            callCounts[command.opcode]++;
+        }
+    gl->glFinish();
+
+    QString qstrReport;
+    QTextStream report(&qstrReport);
+    report << "Trace: " << setup.size() << " setup calls, " << frame.size() << " calls per frame, " << iWidth << "x" << iHeight << "\n";
+    report << "Replayed " << iterations << " frames in " << QString::number(dTotalMS,'f',3) << " ms ("
+           << QString::number(dTotalMS/iterations,'f',4) << " ms per frame, "
+           << QString::number(iCalls/(dTotalMS/1000.0),'f',0) << " calls/s)\n";
+    for (int i=1;i<CGLTraceFunctions::NumOpcodes;i++)
+    {
+        if (callCounts[i]==0)
+            continue;
+        report << "  " << QString(CGLTraceFunctions::opcodeName(i)).leftJustified(28)
+               << QString::number(callCounts[i]/iterations).rightJustified(8) << " calls/frame "
+               << QString::number(callNanoSeconds[i]/(double)callCounts[i],'f',1).rightJustified(10) << " ns/call "
+               << QString::number(callNanoSeconds[i]/1.0e6,'f',3).rightJustified(10) << " ms total\n";
+    }
+    report.flush();
+    return qstrReport;
+}
+
+int CGLTraceReplay::runHeadless(const QString &fileName, int iterations, const QString &recordDirectory)
+{
+    CGLTraceReplay replay;
+    if (!replay.load(fileName))
+        return 1;
+    QSurfaceFormat format;
+    format.setVersion(4,0);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    QOpenGLContext context;
+    context.setFormat(format);
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+    if (!context.create() || !context.makeCurrent(&surface))
+    {
+        qDebug() << "Could not create an OpenGL 4.0 core context for the replay";
+        return 1;
+    }
+    QOpenGLFramebufferObject fbo(replay.frameSize(),QOpenGLFramebufferObject::Depth);
+    fbo.bind();
+    if (!replay.initialize(context.versionFunctions<QOpenGLFunctions_4_0_Core>()))
+    {
+        qDebug() << "OpenGLFunctions not initialized or not supported";
+        return 1;
+    }
+    replay.gl->glViewport(0,0,replay.iWidth,replay.iHeight);
+    replay.gl->glEnable(GL_DEPTH_TEST);
+    QTextStream(stdout) << replay.benchmark(iterations);
+    if (!recordDirectory.isEmpty())
+    {
+        //a separate pass, so the readbacks don't show up in the benchmark
+        CFrameRecorder recorder;
+        if (recorder.initialize(replay.gl) && recorder.start(recordDirectory))
+        {
+            for (int i=0;i<iterations;i++)
+            {
+                replay.replayFrame();
+                recorder.captureFrame(fbo.handle(),replay.iWidth,replay.iHeight);
+            }
+            recorder.stop();
+            QTextStream(stdout) << recorder.statistics() << "\n";
+        }
+        recorder.deleteBuffers();
+    }
+    qDeleteAll(replay.shaderPrograms);
+    replay.shaderPrograms.clear();
+    fbo.release();
+    context.doneCurrent();
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef GLTRACEREPLAY_H
+#define GLTRACEREPLAY_H
+
+#include "gltrace.h"
+
+#include <QtCore>
+
+class QOpenGLShaderProgram;
+
+
+// Replays a trace written by CGLTraceFunctions. The resource snapshot at the
+// start of the trace is executed once, the captured frame as often as
+// requested. Object names and uniform locations are mapped to the ones of the
+// replaying context.
+class CGLTraceReplay
+{
+public:
+    CGLTraceReplay();
+    ~CGLTraceReplay();
+    bool load(const QString &fileName);
+    QSize frameSize() const {return QSize(iWidth,iHeight);}
+    bool initialize(QOpenGLFunctions_4_0_Core *);
+    void replaySetup();
+    void replayFrame();
+    QString benchmark(int iterations);
+    static int runHeadless(const QString &fileName, int iterations, const QString &recordDirectory=QString());
+
+protected:
+    struct SCommand
+    {
+        quint8 opcode;
+        quint64 args[6];
+        QByteArray data;
+    };
+    struct SProgram
+    {
+        quint32 id;
+        QList<QPair<quint32,QByteArray> > shaders;
+        QList<QPair<QByteArray,qint32> > uniforms;
+        QList<QPair<QByteArray,qint32> > blocks;
+    };
+    bool readCommand(QDataStream &stream, SCommand &command);
+    void execute(const SCommand &command);
+    void defineProgram(const SProgram &program);
+    GLuint mapped(QHash<GLuint,GLuint> &names, GLuint name, int opcode);
+    GLint uniformLocation(GLint location);
+    float floatArg(const SCommand &command, int index) const;
+
+    int iWidth=0;
+    int iHeight=0;
+    QVector<SCommand> setup, frame;
+    QVector<SProgram> programs;
+    QHash<GLuint,GLuint> buffers, vertexArrays, queries;
+    QHash<GLuint,QOpenGLShaderProgram*> shaderPrograms;
+    QHash<GLuint,QHash<GLint,GLint> > uniformLocations;
+    GLuint uiCurrentProgram=0;
+    QOpenGLFunctions_4_0_Core* gl = 0;
+};
+
+#endif // GLTRACEREPLAY_H
@@ -0,0 +1,90 @@
+#include "gputimer.h"
+
+#include "gltrace.h"
+
+
+CGpuTimer::CGpuTimer()
+{
+    for (int i=0;i<NumQueries;i++)
+    {
+        Queries[i]=0;
+        bInFlight[i]=false;
+    }
+}
+CGpuTimer::~CGpuTimer()
+{
+    deleteQueries();
+}
+bool CGpuTimer::initialize(CGLTraceFunctions *functions)
+{
+    gl=functions;
+    if (!gl)
+        return false;
+    gl->glGenQueries(NumQueries,Queries);
+    return Queries[0]!=0;
+}
+void CGpuTimer::deleteQueries()
+{
+    if (!gl || Queries[0]==0)
+        return;
+    gl->glDeleteQueries(NumQueries,Queries);
+    for (int i=0;i<NumQueries;i++)
+    {
+        Queries[i]=0;
+        bInFlight[i]=false;
+    }
+}
+void CGpuTimer::begin()
+{
+    bActive=false;
+    if (!gl || Queries[0]==0)
+        return;
+    poll();
+    if (bInFlight[iCurrent]) //all queries still pending, skip this measurement
+        return;
+    gl->glBeginQuery(GL_TIME_ELAPSED,Queries[iCurrent]);
+    bActive=true;
+}
+void CGpuTimer::end()
+{
+    if (!bActive)
+        return;
+    gl->glEndQuery(GL_TIME_ELAPSED);
+    bInFlight[iCurrent]=true;
+    iCurrent=(iCurrent+1)%NumQueries;
+    bActive=false;
+}
+bool CGpuTimer::poll()
+{
+    bool bNewResult=false;
+    for (int i=0;i<NumQueries;i++)
+    {
+        int iQuery=(iCurrent+i)%NumQueries; //oldest first
+        if (!bInFlight[iQuery])
+            continue;
+        GLuint uiAvailable=0;
+        gl->glGetQueryObjectuiv(Queries[iQuery],GL_QUERY_RESULT_AVAILABLE,&uiAvailable);
+        if (!uiAvailable)
+            break;
+        GLuint64 uiNanoSeconds=0;
+        gl->glGetQueryObjectui64v(Queries[iQuery],GL_QUERY_RESULT,&uiNanoSeconds);
+        dLastMS=uiNanoSeconds/1.0e6;
+        bInFlight[iQuery]=false;
+        bNewResult=true;
+    }
+    return bNewResult;
+}
+double CGpuTimer::waitForResult()
+{
+    for (int i=0;i<NumQueries;i++)
+    {
+        int iQuery=(iCurrent+i)%NumQueries;
+        if (!bInFlight[iQuery])
+            continue;
+        GLuint64 uiNanoSeconds=0;
+        gl->glGetQueryObjectui64v(Queries[iQuery],GL_QUERY_RESULT,&uiNanoSeconds);
+        dLastMS=uiNanoSeconds/1.0e6;
+        bInFlight[iQuery]=false;
+    }
+    return dLastMS;
+}
@@ -0,0 +1,34 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <GL/gl.h>
+#include <QtCore>
+
+class CGLTraceFunctions;
+
+
+// Measures GPU time with a small ring of GL_TIME_ELAPSED queries. Results are
+// collected a few frames late so reading them never stalls the pipeline.
+class CGpuTimer
+{
+public:
+    CGpuTimer();
+    ~CGpuTimer();
+    bool initialize(CGLTraceFunctions *);
+    void deleteQueries();
+    void begin();
+    void end();
+    bool poll();
+    double waitForResult();
+    double lastMS() const {return dLastMS;}
+protected:
+    enum { NumQueries = 4 };
+    GLuint Queries[NumQueries];
+    bool bInFlight[NumQueries];
+    int iCurrent=0;
+    bool bActive=false;
+    double dLastMS=0.0;
+    CGLTraceFunctions* gl = 0;
+};
+
+#endif // GPUTIMER_H
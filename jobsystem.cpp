@@ -0,0 +1,111 @@
+#include "jobsystem.h"
+
+#include <algorithm>
+
+
+CJobSystem::CJobSystem(int threads)
+    :iThreadCount(threads),iQueuedJobs(0),iPendingJobs(0)
+{
+    if (iThreadCount<=0)
+        iThreadCount=std::max(1u,std::thread::hardware_concurrency());
+    for (int i=0;i<iThreadCount;i++)
+        queues.push_back(new SQueue);
+    for (int i=1;i<iThreadCount;i++)
+        workers.push_back(std::thread(&CJobSystem::workerLoop,this,i));
+}
+CJobSystem::~CJobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        bQuit=true;
+    }
+    wakeCondition.notify_all();
+    for (size_t i=0;i<workers.size();i++)
+        workers[i].join();
+    for (size_t i=0;i<queues.size();i++)
+        delete queues[i];
+}
+
+void CJobSystem::parallelFor(int count, int grainSize, const JobFunction &function)
+{
+    if (count<=0)
+        return;
+    grainSize=std::max(1,grainSize);
+    if (iThreadCount==1 || count<=grainSize)
+    {
+        function(0,count,0);
+        return;
+    }
+    std::lock_guard<std::mutex> submitLock(submitMutex);
+    int iJobs=(count+grainSize-1)/grainSize;
+    iPendingJobs=iJobs;
+    for (int i=0;i<iJobs;i++)
+    {
+        SJob job = {&function, i*grainSize, std::min(count,(i+1)*grainSize)};
+        SQueue *queue=queues[i%iThreadCount];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->jobs.push_back(job);
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        iQueuedJobs+=iJobs;
+    }
+    wakeCondition.notify_all();
+    while (iPendingJobs.load()>0)
+    {
+        SJob job;
+        if (popJob(0,job))
+            runJob(job,0);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void CJobSystem::workerLoop(int thread)
+{
+    for (;;)
+    {
+        SJob job;
+        if (popJob(thread,job))
+        {
+            runJob(job,thread);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeCondition.wait(lock,[this]{return bQuit || iQueuedJobs.load()>0;});
+        if (bQuit)
+            return;
+    }
+}
+bool CJobSystem::popJob(int thread, SJob &job)
+{
+    {
+        SQueue *own=queues[thread];
+        std::lock_guard<std::mutex> lock(own->mutex);
+        if (!own->jobs.empty())
+        {
+            job=own->jobs.back();
+            own->jobs.pop_back();
+            iQueuedJobs--;
+            return true;
+        }
+    }
+    for (int i=1;i<iThreadCount;i++)
+    {
+        SQueue *victim=queues[(thread+i)%iThreadCount];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->jobs.empty())
+        {
+            job=victim->jobs.front();
+            victim->jobs.pop_front();
+            iQueuedJobs--;
+            return true;
+        }
+    }
+    return false;
+}
+void CJobSystem::runJob(const SJob &job, int thread)
+{
+    (*job.function)(job.begin,job.end,thread);
+    iPendingJobs--;
+}
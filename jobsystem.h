@@ -0,0 +1,55 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+typedef std::function<void(int begin, int end, int thread)> JobFunction;
+
+// Small fork/join job system. Every thread owns a job deque, works LIFO on its
+// own jobs and steals FIFO from the others once it runs dry. The calling thread
+// takes part as thread 0, so thread indices run from 0 to threadCount()-1.
+class CJobSystem
+{
+public:
+    explicit CJobSystem(int threads=0);
+    ~CJobSystem();
+    int threadCount() const {return iThreadCount;}
+    void parallelFor(int count, int grainSize, const JobFunction &function);
+protected:
+    struct SJob
+    {
+        const JobFunction *function;
+        int begin;
+        int end;
+    };
+    struct SQueue
+    {
+        std::mutex mutex;
+        std::deque<SJob> jobs;
+    };
+    void workerLoop(int thread);
+    bool popJob(int thread, SJob &job);
+    void runJob(const SJob &job, int thread);
+
+    int iThreadCount;
+    std::vector<std::thread> workers;
+    std::vector<SQueue*> queues;
+    std::mutex submitMutex;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::atomic<int> iQueuedJobs;
+    std::atomic<int> iPendingJobs;
+    bool bQuit=false;
+private:
+    CJobSystem(const CJobSystem &);
+    CJobSystem &operator=(const CJobSystem &);
+};
+
+#endif // JOBSYSTEM_H
@@ -1,9 +1,24 @@
 #include "mainwindow.h"
+#include "gltracereplay.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    //OpenGLExample --replay <trace> [iterations] [--record <directory>] replays a captured frame without a window
+    QStringList args=a.arguments();
+    if (args.size()>=3 && args[1]=="--replay")
+    {
+        QString qstrRecord;
+        int iRecord=args.indexOf("--record");
+        if (iRecord>=0 && iRecord+1<args.size())
+        {
+            qstrRecord=args[iRecord+1];
+            args.erase(args.begin()+iRecord,args.begin()+iRecord+2);
+        }
+        return CGLTraceReplay::runHeadless(args[2],args.size()>=4?args[3].toInt():1000,qstrRecord);
+    }
+
     MainWindow w;
     w.show();
 
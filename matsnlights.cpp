@@ -1,29 +1,35 @@
 #include "matsnlights.h"
 
+#include "gltrace.h"
+
 #include <QOpenGLShaderProgram>
-#include <QOpenGLFunctions_4_0_Core>
 #include <QOpenGLContext>
 
 
 CMaterial::CMaterial()
     :emissive(Qt::black),ambient(Qt::darkGray),diffuse(Qt::lightGray),specular(Qt::white),shininess(64.0f)
-{}
+{updateValues();}
 CMaterial::CMaterial(QColor em, QColor am, QColor dif, QColor spec, GLfloat shininess)
     :emissive(em),ambient(am),diffuse(dif),specular(spec),shininess(shininess)
-{}
+{updateValues();}
 CMaterial::CMaterial(const CMaterial &mat)
     :emissive(mat.emissive),ambient(mat.ambient),diffuse(mat.diffuse),specular(mat.specular),shininess(mat.shininess)
-{}
+{updateValues();}
 
-void CMaterial::use(QOpenGLShaderProgram *m_program)
+//converts the colors once, call again after changing them
+void CMaterial::updateValues()
 {
-    m_program->bind();
     vecValues[0]=QVector3D(emissive.redF(),emissive.greenF(),emissive.blueF());
     vecValues[1]=QVector3D(ambient.redF(),ambient.greenF(),ambient.blueF());
     vecValues[2]=QVector3D(diffuse.redF(),diffuse.greenF(),diffuse.blueF());
     vecValues[3]=QVector3D(specular.redF(),specular.greenF(),specular.blueF());
-    m_program->setUniformValueArray("mat",vecValues,4);
-    m_program->setUniformValue("mat_shininess",shininess);
+}
+
+void CMaterial::use(QOpenGLShaderProgram *m_program, CGLTraceFunctions *gl)
+{
+    m_program->bind();
+    gl->glUniform3fv(m_program->uniformLocation("mat"),4,reinterpret_cast<const GLfloat*>(vecValues));
+    gl->glUniform1f(m_program->uniformLocation("mat_shininess"),shininess);
 }
 
 
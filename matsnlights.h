@@ -7,7 +7,7 @@
 #include <QVector3D>
 
 class QOpenGLShaderProgram;
-class QOpenGLFunctions_4_0_Core;
+class CGLTraceFunctions;
 
 
 class CMaterial
@@ -23,7 +23,8 @@ public:
     CMaterial(QColor em, QColor am, QColor dif, QColor spec, GLfloat shininess);
     CMaterial(const CMaterial &mat);
     static CMaterial emerald,gold,ruby;
-    void use(QOpenGLShaderProgram *);
+    void use(QOpenGLShaderProgram *, CGLTraceFunctions *gl);
+    void updateValues();
 };
 
 /*class CLight
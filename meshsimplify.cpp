@@ -0,0 +1,502 @@
+#include "meshsimplify.h"
+
+#include <QVector3D>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <vector>
+
+
+// Symmetric 4x4 matrix of a weighted sum of squared plane distances
+struct SQuadric
+{
+    double a[10];
+    double dWeight;
+    SQuadric() {clear();}
+    void clear()
+    {
+        for (int i=0;i<10;i++)
+            a[i]=0.0;
+        dWeight=0.0;
+    }
+    void addPlane(const QVector3D &n, double d, double weight)
+    {
+        double x=n.x(),y=n.y(),z=n.z();
+        a[0]+=weight*x*x; a[1]+=weight*x*y; a[2]+=weight*x*z; a[3]+=weight*x*d;
+        a[4]+=weight*y*y; a[5]+=weight*y*z; a[6]+=weight*y*d;
+        a[7]+=weight*z*z; a[8]+=weight*z*d;
+        a[9]+=weight*d*d;
+        dWeight+=weight;
+    }
+    void add(const SQuadric &q)
+    {
+        for (int i=0;i<10;i++)
+            a[i]+=q.a[i];
+        dWeight+=q.dWeight;
+    }
+    double evaluate(const QVector3D &p) const
+    {
+        double x=p.x(),y=p.y(),z=p.z();
+        return a[0]*x*x+2.0*a[1]*x*y+2.0*a[2]*x*z+2.0*a[3]*x
+              +a[4]*y*y+2.0*a[5]*y*z+2.0*a[6]*y
+              +a[7]*z*z+2.0*a[8]*z+a[9];
+    }
+    //position with the smallest error, Cramer's rule on the 3x3 gradient system
+    bool optimum(QVector3D &p) const
+    {
+        double scale=a[0]+a[4]+a[7];
+        double det=a[0]*(a[4]*a[7]-a[5]*a[5])-a[1]*(a[1]*a[7]-a[5]*a[2])+a[2]*(a[1]*a[5]-a[4]*a[2]);
+        if (scale<=0.0 || std::fabs(det)<=1.0e-9*scale*scale*scale)
+            return false;
+        double bx=-a[3],by=-a[6],bz=-a[8];
+        double x=(bx*(a[4]*a[7]-a[5]*a[5])-a[1]*(by*a[7]-a[5]*bz)+a[2]*(by*a[5]-a[4]*bz))/det;
+        double y=(a[0]*(by*a[7]-a[5]*bz)-bx*(a[1]*a[7]-a[5]*a[2])+a[2]*(a[1]*bz-by*a[2]))/det;
+        double z=(a[0]*(a[4]*bz-by*a[5])-a[1]*(a[1]*bz-by*a[2])+bx*(a[1]*a[5]-a[4]*a[2]))/det;
+        p=QVector3D(x,y,z);
+        return true;
+    }
+};
+
+struct SWorkMesh
+{
+    std::vector<QVector3D> positions, normals;
+    std::vector<SQuadric> quadrics;
+    std::vector<int> versions;
+    std::vector<std::vector<int> > vertexTriangles;
+    std::vector<GLuint> triangles;
+    std::vector<char> removed;
+    int iLiveTriangles=0;
+    bool bNormals=false;
+    double dError=0.0;
+};
+
+struct SCollapse
+{
+    double dCost;
+    double dError;
+    int iKeep, iRemove;
+    int iKeepVersion, iRemoveVersion;
+    QVector3D position;
+    bool operator<(const SCollapse &other) const {return dCost>other.dCost;} //cheapest on top
+};
+
+
+static QVector3D triangleNormal(const QVector3D &p0, const QVector3D &p1, const QVector3D &p2)
+{
+    return QVector3D::crossProduct(p1-p0,p2-p0);
+}
+
+static void loadMesh(SWorkMesh &work, const SMeshData &mesh, double boundaryWeight)
+{
+    int iVertices=mesh.vertexCount();
+    int iTriangles=mesh.triangleCount();
+    work.bNormals=mesh.normals.size()==mesh.positions.size();
+    work.positions.resize(iVertices);
+    work.normals.resize(work.bNormals?iVertices:0);
+    for (int i=0;i<iVertices;i++)
+    {
+        work.positions[i]=QVector3D(mesh.positions[3*i],mesh.positions[3*i+1],mesh.positions[3*i+2]);
+        if (work.bNormals)
+            work.normals[i]=QVector3D(mesh.normals[3*i],mesh.normals[3*i+1],mesh.normals[3*i+2]).normalized();
+    }
+    work.triangles.assign(mesh.indices.constBegin(),mesh.indices.constEnd());
+    work.removed.assign(iTriangles,0);
+    work.iLiveTriangles=iTriangles;
+    work.quadrics.assign(iVertices,SQuadric());
+    work.versions.assign(iVertices,0);
+    work.vertexTriangles.assign(iVertices,std::vector<int>());
+
+    //area weighted triangle planes
+    std::vector<std::pair<quint64,int> > edges;
+    edges.reserve(iTriangles*3);
+    for (int t=0;t<iTriangles;t++)
+    {
+        const GLuint *tri=&work.triangles[3*t];
+        QVector3D n=triangleNormal(work.positions[tri[0]],work.positions[tri[1]],work.positions[tri[2]]);
+        float fLength=n.length();
+        for (int k=0;k<3;k++)
+        {
+            work.vertexTriangles[tri[k]].push_back(t);
+            GLuint v0=tri[k], v1=tri[(k+1)%3];
+            edges.push_back(std::make_pair((quint64)qMin(v0,v1)<<32|qMax(v0,v1),t*3+k));
+        }
+        if (fLength<=0.0f)
+            continue;
+        n/=fLength;
+        for (int k=0;k<3;k++)
+            work.quadrics[tri[k]].addPlane(n,-QVector3D::dotProduct(n,work.positions[tri[0]]),0.5*fLength);
+    }
+    //edges used by one triangle only get a heavy plane perpendicular to the triangle
+    std::sort(edges.begin(),edges.end());
+    for (size_t i=0;i<edges.size();)
+    {
+        size_t j=i+1;
+        while (j<edges.size() && edges[j].first==edges[i].first)
+            j++;
+        if (j==i+1)
+        {
+            int t=edges[i].second/3, k=edges[i].second%3;
+            const GLuint *tri=&work.triangles[3*t];
+            const QVector3D &p0=work.positions[tri[k]], &p1=work.positions[tri[(k+1)%3]];
+            QVector3D n=triangleNormal(work.positions[tri[0]],work.positions[tri[1]],work.positions[tri[2]]);
+            QVector3D e=p1-p0;
+            QVector3D plane=QVector3D::crossProduct(e,n).normalized();
+            if (!plane.isNull())
+            {
+                double d=-QVector3D::dotProduct(plane,p0);
+                work.quadrics[tri[k]].addPlane(plane,d,boundaryWeight*e.lengthSquared());
+                work.quadrics[tri[(k+1)%3]].addPlane(plane,d,boundaryWeight*e.lengthSquared());
+            }
+        }
+        i=j;
+    }
+}
+
+static void computeCollapse(const SWorkMesh &work, int a, int b, SCollapse &collapse)
+{
+    SQuadric q=work.quadrics[a];
+    q.add(work.quadrics[b]);
+    const QVector3D &pa=work.positions[a], &pb=work.positions[b];
+    QVector3D mid=(pa+pb)*0.5f;
+    QVector3D candidates[4]={mid,pa,pb,mid};
+    int iCandidates=3;
+    //an optimum far away from the edge comes from a nearly flat region and is not trusted
+    if (q.optimum(candidates[3]) && (candidates[3]-mid).length()<=(pb-pa).length())
+        iCandidates=4;
+    collapse.dCost=q.evaluate(mid);
+    collapse.position=mid;
+    for (int i=1;i<iCandidates;i++)
+    {
+        double dCost=q.evaluate(candidates[i]);
+        if (dCost<collapse.dCost)
+        {
+            collapse.dCost=dCost;
+            collapse.position=candidates[i];
+        }
+    }
+    collapse.dCost=qMax(0.0,collapse.dCost);
+    collapse.dError=q.dWeight>0.0?std::sqrt(collapse.dCost/q.dWeight):0.0;
+    collapse.iKeep=a;
+    collapse.iRemove=b;
+    collapse.iKeepVersion=work.versions[a];
+    collapse.iRemoveVersion=work.versions[b];
+}
+
+static bool isCollapseValid(const SWorkMesh &work, int a, int b, const QVector3D &position, float minNormalDot, std::vector<int> &linkA, std::vector<int> &linkB)
+{
+    if (work.bNormals && QVector3D::dotProduct(work.normals[a],work.normals[b])<minNormalDot)
+        return false;
+    //link condition: the common neighbours must be exactly the opposite corners of the shared triangles
+    int iShared=0;
+    linkA.clear();
+    linkB.clear();
+    for (int side=0;side<2;side++)
+    {
+        int v=side?b:a;
+        std::vector<int> &link=side?linkB:linkA;
+        for (int t : work.vertexTriangles[v])
+        {
+            if (work.removed[t])
+                continue;
+            const GLuint *tri=&work.triangles[3*t];
+            for (int k=0;k<3;k++)
+                if ((int)tri[k]!=a && (int)tri[k]!=b)
+                    link.push_back(tri[k]);
+            if ((int)tri[0]==(side?a:b) || (int)tri[1]==(side?a:b) || (int)tri[2]==(side?a:b))
+            {
+                //shared triangles disappear, they can't flip
+                if (side==0)
+                    iShared++;
+                continue;
+            }
+            //the triangle must not flip or tilt too far when v moves
+            QVector3D p[3];
+            for (int k=0;k<3;k++)
+                p[k]=(int)tri[k]==v?position:work.positions[tri[k]];
+            QVector3D nOld=triangleNormal(work.positions[tri[0]],work.positions[tri[1]],work.positions[tri[2]]);
+            QVector3D nNew=triangleNormal(p[0],p[1],p[2]);
+            if (nNew.lengthSquared()<=1.0e-12f*nOld.lengthSquared() || QVector3D::dotProduct(nOld.normalized(),nNew.normalized())<0.2f)
+                return false;
+        }
+    }
+    if (iShared==0)
+        return false;
+    std::sort(linkA.begin(),linkA.end());
+    linkA.erase(std::unique(linkA.begin(),linkA.end()),linkA.end());
+    std::sort(linkB.begin(),linkB.end());
+    linkB.erase(std::unique(linkB.begin(),linkB.end()),linkB.end());
+    int iCommon=0;
+    for (size_t i=0,j=0;i<linkA.size() && j<linkB.size();)
+    {
+        if (linkA[i]<linkB[j]) i++;
+        else if (linkB[j]<linkA[i]) j++;
+        else {iCommon++;i++;j++;}
+    }
+    return iCommon==iShared;
+}
+
+static int collapseEdge(SWorkMesh &work, int a, int b, const QVector3D &position)
+{
+    int iRemoved=0;
+    std::vector<int> &trianglesA=work.vertexTriangles[a];
+    for (int t : work.vertexTriangles[b])
+    {
+        if (work.removed[t])
+            continue;
+        GLuint *tri=&work.triangles[3*t];
+        if ((int)tri[0]==a || (int)tri[1]==a || (int)tri[2]==a)
+        {
+            work.removed[t]=1;
+            iRemoved++;
+            continue;
+        }
+        for (int k=0;k<3;k++)
+            if ((int)tri[k]==b)
+                tri[k]=a;
+        trianglesA.push_back(t);
+    }
+    trianglesA.erase(std::remove_if(trianglesA.begin(),trianglesA.end(),[&work](int t){return work.removed[t]!=0;}),trianglesA.end());
+    work.vertexTriangles[b].clear();
+    work.quadrics[a].add(work.quadrics[b]);
+    if (work.bNormals)
+    {
+        QVector3D n=work.normals[a]+work.normals[b];
+        if (!n.isNull())
+            work.normals[a]=n.normalized();
+    }
+    work.positions[a]=position;
+    work.versions[a]++;
+    work.versions[b]++;
+    return iRemoved;
+}
+
+// Collapses edges between vertices owned by this slab only. Locked vertices and
+// the triangles of other slabs are never written, so slabs can run concurrently.
+// A slab hemmed in by its locked borders would reach its target only with bad
+// collapses, those above maxError are left to the serial pass.
+static int simplifySlab(SWorkMesh &work, const std::vector<int> &slabTriangles, const std::vector<int> &vertexSlab, int slab,
+                        int target, float minNormalDot, double maxError, double &error)
+{
+    std::priority_queue<SCollapse> heap;
+    SCollapse collapse;
+    for (int t : slabTriangles)
+        for (int k=0;k<3;k++)
+        {
+            int a=work.triangles[3*t+k], b=work.triangles[3*t+(k+1)%3];
+            if (vertexSlab[a]!=slab || vertexSlab[b]!=slab)
+                continue;
+            computeCollapse(work,a,b,collapse);
+            heap.push(collapse);
+        }
+    int iLive=(int)slabTriangles.size();
+    int iRemoved=0;
+    std::vector<int> linkA, linkB;
+    while (iLive-iRemoved>target && !heap.empty())
+    {
+        collapse=heap.top();
+        heap.pop();
+        int a=collapse.iKeep, b=collapse.iRemove;
+        if (work.versions[a]!=collapse.iKeepVersion || work.versions[b]!=collapse.iRemoveVersion || collapse.dError>maxError)
+            continue;
+        if (!isCollapseValid(work,a,b,collapse.position,minNormalDot,linkA,linkB))
+            continue;
+        iRemoved+=collapseEdge(work,a,b,collapse.position);
+        error=qMax(error,collapse.dError);
+        for (int t : work.vertexTriangles[a])
+            for (int k=0;k<3;k++)
+            {
+                int v=work.triangles[3*t+k];
+                if (v==a || vertexSlab[v]!=slab)
+                    continue;
+                SCollapse next;
+                computeCollapse(work,a,v,next);
+                heap.push(next);
+            }
+    }
+    return iRemoved;
+}
+
+static SMeshData compactMesh(const SWorkMesh &work)
+{
+    SMeshData mesh;
+    std::vector<int> remap(work.positions.size(),-1);
+    int iVertices=0;
+    for (size_t t=0;t<work.removed.size();t++)
+    {
+        const GLuint *tri=&work.triangles[3*t];
+        if (work.removed[t] || tri[0]==tri[1] || tri[1]==tri[2] || tri[0]==tri[2])
+            continue;
+        for (int k=0;k<3;k++)
+        {
+            if (remap[tri[k]]<0)
+            {
+                remap[tri[k]]=iVertices++;
+                const QVector3D &p=work.positions[tri[k]];
+                mesh.positions << p.x() << p.y() << p.z();
+                if (work.bNormals)
+                {
+                    const QVector3D &n=work.normals[tri[k]];
+                    mesh.normals << n.x() << n.y() << n.z();
+                }
+            }
+            mesh.indices << remap[tri[k]];
+        }
+    }
+    return mesh;
+}
+
+
+CMeshSimplifier::CMeshSimplifier(CJobSystem *jobSystem, int partitions)
+    :jobs(jobSystem),iPartitions(partitions)
+{
+    if (iPartitions<=0)
+        iPartitions=jobs?jobs->threadCount()*4:1;
+}
+
+void CMeshSimplifier::simplifyPass(SWorkMesh &work, int targetTriangles, int slabs, float slabOffset, double maxError)
+{
+    if (work.iLiveTriangles<=targetTriangles || work.positions.empty())
+        return;
+    QVector3D boxMin=work.positions[0], boxMax=work.positions[0];
+    for (const QVector3D &p : work.positions)
+        for (int i=0;i<3;i++)
+        {
+            boxMin[i]=qMin(boxMin[i],p[i]);
+            boxMax[i]=qMax(boxMax[i],p[i]);
+        }
+    QVector3D extent=boxMax-boxMin;
+    int iAxis=extent.x()>=extent.y()?(extent.x()>=extent.z()?0:2):(extent.y()>=extent.z()?1:2);
+    float fWidth=qMax(extent[iAxis]/slabs,1.0e-6f);
+    int iSlabs=slabs+(slabOffset>0.0f?1:0);
+
+    //triangles go to the slab of their centroid, vertices used by two slabs are locked (-2)
+    std::vector<std::vector<int> > slabTriangles(iSlabs);
+    std::vector<int> vertexSlab(work.positions.size(),-1);
+    for (size_t t=0;t<work.removed.size();t++)
+    {
+        if (work.removed[t])
+            continue;
+        const GLuint *tri=&work.triangles[3*t];
+        float fCentroid=(work.positions[tri[0]][iAxis]+work.positions[tri[1]][iAxis]+work.positions[tri[2]][iAxis])/3.0f;
+        int iSlab=qBound(0,(int)std::floor((fCentroid-boxMin[iAxis])/fWidth+slabOffset),iSlabs-1);
+        slabTriangles[iSlab].push_back(t);
+        for (int k=0;k<3;k++)
+        {
+            int &owner=vertexSlab[tri[k]];
+            owner=owner==-1?iSlab:(owner==iSlab?iSlab:-2);
+        }
+    }
+
+    double dRatio=(double)targetTriangles/work.iLiveTriangles;
+    std::vector<int> removedPerSlab(iSlabs,0);
+    std::vector<double> errorPerSlab(iSlabs,0.0);
+    JobFunction slabJob=[&](int begin, int end, int)
+    {
+        for (int s=begin;s<end;s++)
+            removedPerSlab[s]=simplifySlab(work,slabTriangles[s],vertexSlab,s,qRound(slabTriangles[s].size()*dRatio),
+                                           fMinNormalDot,maxError,errorPerSlab[s]);
+    };
+    if (jobs && iSlabs>1)
+        jobs->parallelFor(iSlabs,1,slabJob);
+    else
+        slabJob(0,iSlabs,0);
+    for (int s=0;s<iSlabs;s++)
+    {
+        work.iLiveTriangles-=removedPerSlab[s];
+        work.dError=qMax(work.dError,errorPerSlab[s]);
+    }
+}
+
+SMeshData CMeshSimplifier::simplify(const SMeshData &mesh, int targetTriangles, double *error)
+{
+    SWorkMesh work;
+    loadMesh(work,mesh,dBoundaryWeight);
+    if (iPartitions>1 && !work.positions.empty())
+    {
+        QVector3D boxMin=work.positions[0], boxMax=work.positions[0];
+        for (const QVector3D &p : work.positions)
+            for (int i=0;i<3;i++)
+            {
+                boxMin[i]=qMin(boxMin[i],p[i]);
+                boxMax[i]=qMax(boxMax[i],p[i]);
+            }
+        double dMaxError=dParallelErrorLimit*(boxMax-boxMin).length();
+        simplifyPass(work,targetTriangles,iPartitions,0.0f,dMaxError);
+        simplifyPass(work,targetTriangles,iPartitions,0.5f,dMaxError);
+    }
+    //whatever the locked borders kept back is finished serially
+    simplifyPass(work,targetTriangles,1,0.0f,std::numeric_limits<double>::max());
+    if (error)
+        *error=work.dError;
+    return compactMesh(work);
+}
+
+QVector<SMeshData> CMeshSimplifier::buildLodChain(const SMeshData &mesh, int levels, float ratio, QVector<SLodLevel> *stats)
+{
+    QVector<SMeshData> chain;
+    chain.append(mesh);
+    if (stats)
+    {
+        stats->clear();
+        SLodLevel level={mesh.triangleCount(),0.0,0.0};
+        stats->append(level);
+    }
+    double dError=0.0;
+    for (int i=1;i<levels;i++)
+    {
+        int iPrevious=chain.last().triangleCount();
+        int iTarget=qRound(iPrevious*ratio);
+        if (iTarget<4)
+            break;
+        QElapsedTimer elapsed;
+        elapsed.start();
+        double dLevelError=0.0;
+        SMeshData level=simplify(chain.last(),iTarget,&dLevelError);
+        double dMS=elapsed.nsecsElapsed()/1.0e6;
+        if (level.triangleCount()>=iPrevious)
+            break;
+        //every level is built from the previous one, so the errors add up at most
+        dError+=dLevelError;
+        chain.append(level);
+        if (stats)
+        {
+            SLodLevel info={level.triangleCount(),dError,dMS};
+            stats->append(info);
+        }
+    }
+    return chain;
+}
+
+QString CMeshSimplifier::benchmark(const SMeshData &mesh, int levels)
+{
+    QString qstrReport=QString("LOD chain of %1 triangles:").arg(mesh.triangleCount());
+    int iMaxThreads=qMax(1,QThread::idealThreadCount());
+    double dSingleMS=0.0;
+    QVector<SLodLevel> stats;
+    for (int iThreads=1;;iThreads=qMin(iThreads*2,iMaxThreads))
+    {
+        //the same partitioning for every thread count, so all runs do the same work
+        CJobSystem jobSystem(iThreads);
+        CMeshSimplifier simplifier(&jobSystem,iMaxThreads*4);
+        QElapsedTimer elapsed;
+        elapsed.start();
+        simplifier.buildLodChain(mesh,levels,0.5f,&stats);
+        double dMS=elapsed.nsecsElapsed()/1.0e6;
+        if (iThreads==1)
+        {
+            dSingleMS=dMS;
+            for (int i=1;i<stats.size();i++)
+                qstrReport+=QString(" level %1: %2 triangles, error %3 (%4 ms)").arg(i).arg(stats[i].iTriangles)
+                        .arg(stats[i].dError,0,'g',3).arg(stats[i].dMS,0,'f',1);
+        }
+        qint64 iReduced=0;
+        for (int i=1;i<stats.size();i++)
+            iReduced+=stats[i-1].iTriangles-stats[i].iTriangles;
+        qstrReport+=QString(" %1 threads: %2 ms, %3 M triangles/s (x%4)").arg(iThreads).arg(dMS,0,'f',1)
+                .arg(dMS>0.0?iReduced/dMS/1000.0:0.0,0,'f',2).arg(dSingleMS/dMS,0,'f',2);
+        if (iThreads==iMaxThreads)
+            break;
+    }
+    return qstrReport;
+}
@@ -0,0 +1,48 @@
+#ifndef MESHSIMPLIFY_H
+#define MESHSIMPLIFY_H
+
+#include "renderobjects.h"
+#include "jobsystem.h"
+
+#include <QtCore>
+
+
+struct SWorkMesh;
+
+struct SLodLevel
+{
+    int iTriangles;
+    double dError;
+    double dMS;
+};
+
+
+// Quadric error metric simplification (Garland/Heckbert) of indexed triangle
+// meshes. Every vertex accumulates the planes of its triangles; edges are
+// collapsed cheapest first to the position minimizing the summed squared
+// distances. Boundary edges add perpendicular penalty planes, collapses that
+// fold triangles or merge vertices with diverging normals are rejected.
+// The mesh is cut into slabs that are simplified in parallel on a CJobSystem,
+// vertices shared by two slabs are locked. A second pass with slabs shifted by
+// half a slab collapses the former borders. Collapses with an error above a
+// fraction of the mesh size are left to a final serial pass over the whole mesh.
+class CMeshSimplifier
+{
+public:
+    explicit CMeshSimplifier(CJobSystem *jobSystem=0, int partitions=0);
+    SMeshData simplify(const SMeshData &mesh, int targetTriangles, double *error=0);
+    QVector<SMeshData> buildLodChain(const SMeshData &mesh, int levels, float ratio=0.5f, QVector<SLodLevel> *stats=0);
+    void setBoundaryWeight(double weight) {dBoundaryWeight=weight;}
+    void setMinNormalDot(float dot) {fMinNormalDot=dot;}
+    void setParallelErrorLimit(double fractionOfSize) {dParallelErrorLimit=fractionOfSize;}
+    static QString benchmark(const SMeshData &mesh, int levels=5);
+protected:
+    void simplifyPass(SWorkMesh &work, int targetTriangles, int slabs, float slabOffset, double maxError);
+    CJobSystem *jobs;
+    int iPartitions;
+    double dBoundaryWeight=1000.0;
+    float fMinNormalDot=0.5f;
+    double dParallelErrorLimit=0.001;
+};
+
+#endif // MESHSIMPLIFY_H
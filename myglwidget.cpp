@@ -1,11 +1,13 @@
 #include "myglwidget.h"
+#include "meshsimplify.h"
 #include <QTimer>
 #include <QMouseEvent>
 
 
 
 MyGLWidget::MyGLWidget(QWidget *parent)
-    : QOpenGLWidget(parent), QOpenGLFunctions_4_0_Core(), bRotate(false),zoomFactor(5.0f),oldMouseX(0),oldMouseY(0)
+    : QOpenGLWidget(parent), CGLTraceFunctions(), bRotate(false),zoomFactor(5.0f),oldMouseX(0),oldMouseY(0),
+      tessToroid(CParametricSurface::Torus),tessPlane(CParametricSurface::Plane),lodToroid("Torus LOD",CMaterial::ruby),bShowStatistics(false),bCaptureFrame(false),bBenchmarkWireframe(false),bBenchmarkGrid(false),renderQueue(&jobSystem),overlayQueue(&jobSystem),iToroidObject(0),iCoordSysObject(0),iGroundObject(-1)
 {
     timer = new QTimer(this);
     connect(timer, SIGNAL(timeout()), this, SLOT(update()));
@@ -14,49 +16,127 @@ MyGLWidget::MyGLWidget(QWidget *parent)
 
 void MyGLWidget::initializeGL()
 {
+    residency.startTiming();
     initializeOpenGLFunctions();
     glEnable(GL_DEPTH_TEST);
     QString versionString1(QLatin1String(reinterpret_cast<const char*>(glGetString(GL_VERSION))));
     emit(showStatusBarMessage(QString("OpenGL Version: ")+versionString1,10000));
-    plane.initialize(this);
-    coordSys.initialize(this);
-    cuboid.initialize(this);
-    toroid.initialize(this);
+    streamBuffer.initialize(this);
+    CBaseObjectFactory::setStreamBuffer(&streamBuffer);
+    //objects become resident when they are drawn for the first time
+    residency.manage(&plane,this);
+    residency.manage(&coordSys,this);
+    residency.manage(&cuboid,this);
+    residency.manage(&toroid,this);
+    residency.manage(&tessToroid,this);
+    residency.manage(&tessPlane,this);
+    residency.manage(&lodToroid,this);
+    residency.manage(&groundGrid,this);
+    groundGrid.reshapeGrid(64,64,3.0f,3.0f);
+    groundGrid.setWireframeMode(CBaseObjectFactory::ShaderSolidWire);
+    dynamicResolution.initialize(this);
+    occlusionCuller.initialize(this,this);
+    frameRecorder.initialize(this);
+    renderCache.initialize(this);
+    statusTimer.start();
 
+    scene.clear();
+    overlay.clear();
+    iToroidObject=scene.size();
+    scene.append(CRenderQueue::sceneObject(&toroid));
+    iCoordSysObject=overlay.size();
+    overlay.append(CRenderQueue::sceneObject(&coordSys));
+    iGroundObject=-1;
 }
 
 void MyGLWidget::resizeGL(int w, int h)
 {
     updateProjectionMatrix(w,h);
+    dynamicResolution.resize(qRound(w*devicePixelRatioF()),qRound(h*devicePixelRatioF()));
+    renderCache.resize(qRound(w*devicePixelRatioF()),qRound(h*devicePixelRatioF()));
 }
 
 
 void MyGLWidget::paintGL()
 {
     timer->start(10);
+    if (bCaptureFrame)
+    {
+        bCaptureFrame=false;
+        QSize size=dynamicResolution.renderSize();
+        beginCapture(size.width(),size.height());
+    }
+    dynamicResolution.beginFrame();
+    streamBuffer.beginFrame();
+    occlusionCuller.beginFrame();
+    residency.update(4.0);
     glClear(GL_COLOR_BUFFER_BIT);
     glClear(GL_DEPTH_BUFFER_BIT);
 
 
     QMatrix4x4 camera;
     camera.translate(0.0f,0.0f,-zoomFactor);
-    QMatrix4x4 matrix;
-    QMatrix4x4 coordSysMatrix;
-    QMatrix4x4 normalMatrix;
     if (bRotate)
     {
         camera=camera*currRot;
     }
-    matrix=camera*transformation;
-    coordSysMatrix=camera*transRotOnly;
-    QMatrix4x4 mvp_Matrix=projection*matrix;
+    SSceneObject &toroidObject=scene[iToroidObject];
+    toroidObject.model=transformation;
+    toroidObject.factory->boundingBox(toroidObject.boundsMin,toroidObject.boundsMax);
+    overlay[iCoordSysObject].model=transRotOnly;
 
-    normalMatrix=matrix.inverted().transposed();
-    //cuboid.paint(projection,matrix);
-    toroid.paint(mvp_Matrix,matrix,normalMatrix);
-    //plane.paint(projection,matrix);
-    mvp_Matrix=projection*coordSysMatrix;
-    coordSys.paint(mvp_Matrix);
+    //the static layer is only rendered when something it depends on has changed
+    renderCache.beginKey();
+    renderCache.addKey(camera);
+    renderCache.addKey(projection);
+    for (int i=0;i<scene.size();i++)
+    {
+        renderCache.addKey(scene[i].model);
+        renderCache.addKey(scene[i].factory);
+        renderCache.addKey(scene[i].factory->version());
+    }
+    renderCache.addKey(occlusionCuller.isEnabled()?(occlusionCuller.conditionalRendering()?2:1):0);
+    if (isRecording())
+        renderCache.invalidate(); //a trace has to contain the draw calls
+    if (renderCache.begin(dynamicResolution.renderSize()))
+    {
+        renderQueue.prepare(scene,camera,projection);
+        renderQueue.submit(&streamBuffer,&occlusionCuller);
+        renderCache.end();
+        if (residency.pendingCount()>0)
+            renderCache.invalidate(); //objects still missing from the layer
+    }
+    else
+    {
+        //the reused layer shows what the queue drew on the last miss, keep those recent so the budget evicts culled ones first
+        const QVector<CBaseObjectFactory*> &drawn=renderQueue.drawnFactories();
+        for (int i=0;i<drawn.size();i++)
+            residency.touch(drawn[i]);
+    }
+    overlayQueue.prepare(overlay,camera,projection);
+    overlayQueue.submit(&streamBuffer);
+    if (bBenchmarkWireframe)
+    {
+        bBenchmarkWireframe=false;
+        benchmarkWireframe(camera);
+    }
+    if (bBenchmarkGrid)
+    {
+        bBenchmarkGrid=false;
+        benchmarkGrid(camera);
+    }
+    streamBuffer.endFrame();
+    dynamicResolution.endFrame(defaultFramebufferObject());
+    frameRecorder.captureFrame(defaultFramebufferObject(),qRound(width()*devicePixelRatioF()),qRound(height()*devicePixelRatioF()));
+    residency.frameFinished();
+    if (isRecording())
+    {
+        QString qstrFile=QString("frame_%1.gltrace").arg(QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss"));
+        int iCalls=capturedCalls();
+        if (endCapture(qstrFile))
+            emit showStatusBarMessage(QString("Captured %1 GL calls to %2").arg(iCalls).arg(qstrFile),5000);
+    }
+    showFrameStatus();
 }
 
 
@@ -136,11 +216,185 @@ void MyGLWidget::wheelEvent(QWheelEvent *e)
 
 void MyGLWidget::keyPressEvent(QKeyEvent *e)
 {
-    if (e->key() == Qt::Key_Left)
+    if (e->key() == Qt::Key_Left || e->key() == Qt::Key_Right)
+    {
+        //the tessellated torus is reshaped through uniforms only, no buffers are rebuilt
+        float fInner=qBound(0.05f,tessToroid.innerRadius()+(e->key()==Qt::Key_Right?0.05f:-0.05f),tessToroid.outerRadius()*0.9f);
+        tessToroid.reshapeTorus(tessToroid.outerRadius(),fInner);
+        emit showStatusBarMessage(QString("Tessellated torus radii: %1 / %2").arg(tessToroid.outerRadius(),0,'f',2).arg(fInner,0,'f',2),1000);
+    }
+    else if (e->key() == Qt::Key_T && !scene.isEmpty())
+    {
+        bool bTessellated=scene[iToroidObject].factory!=&tessToroid;
+        scene[iToroidObject].factory=bTessellated?static_cast<CBaseObjectFactory*>(&tessToroid):&toroid;
+        emit showStatusBarMessage(QString("Torus: %1").arg(bTessellated?"GPU tessellation":"CPU mesh"),1000);
+    }
+    else if (e->key() == Qt::Key_Up || e->key() == Qt::Key_Down)
+    {
+        tessToroid.setEdgeLength(tessToroid.edgeLength()*(e->key()==Qt::Key_Up?0.8f:1.25f));
+        tessPlane.setEdgeLength(tessToroid.edgeLength());
+        emit showStatusBarMessage(QString("Tessellation edge length: %1 pixels").arg(tessToroid.edgeLength(),0,'f',1),1000);
+    }
+    else if (e->key() == Qt::Key_R)
+    {
+        dynamicResolution.setEnabled(!dynamicResolution.isEnabled());
+        emit showStatusBarMessage(QString("Dynamic resolution %1").arg(dynamicResolution.isEnabled()?"on":"off"),1000);
+    }
+    else if (e->key() == Qt::Key_O)
+    {
+        if (!occlusionCuller.isEnabled())
+            occlusionCuller.setEnabled(true);
+        else if (!occlusionCuller.conditionalRendering())
+            occlusionCuller.setConditionalRendering(true);
+        else
+        {
+            occlusionCuller.setEnabled(false);
+            occlusionCuller.setConditionalRendering(false);
+        }
+        emit showStatusBarMessage(QString("Occlusion culling %1").arg(!occlusionCuller.isEnabled()?"off":
+                                  (occlusionCuller.conditionalRendering()?"on (conditional rendering)":"on")),1000);
+    }
+    else if (e->key() == Qt::Key_W)
+    {
+        static const CBaseObjectFactory::WireframeMode modes[] = {CBaseObjectFactory::PolygonModeWire, CBaseObjectFactory::ShaderWire,
+                CBaseObjectFactory::ShaderHiddenLine, CBaseObjectFactory::ShaderSolidWire, CBaseObjectFactory::Solid};
+        static const char *names[] = {"glPolygonMode lines", "shader wireframe", "shader hidden line", "shader solid + wireframe", "solid"};
+        int iMode=0;
+        while (iMode<4 && modes[iMode]!=toroid.wireframeMode())
+            iMode++;
+        iMode=(iMode+1)%5;
+        toroid.setWireframeMode(modes[iMode]);
+        lodToroid.setWireframeMode(modes[iMode]);
+        emit showStatusBarMessage(QString("Torus wireframe: %1").arg(names[iMode]),1000);
+    }
+    else if (e->key() == Qt::Key_L && !scene.isEmpty())
+    {
+        //the LOD chain is simplified from the CPU torus the first time, then the levels are cycled
+        if (lodToroid.levelCount()==0)
+        {
+            SMeshData mesh;
+            if (!toroid.meshData(mesh))
+                return;
+            CMeshSimplifier simplifier(&jobSystem);
+            QVector<SLodLevel> stats;
+            QVector<SMeshData> levels=simplifier.buildLodChain(mesh,6,0.5f,&stats);
+            makeCurrent();
+            lodToroid.deleteObject();
+            doneCurrent();
+            lodToroid.setLevels(levels);
+            for (int i=0;i<stats.size();i++)
+                qDebug() << "Torus LOD" << i << ":" << stats[i].iTriangles << "triangles, error" << stats[i].dError << "," << stats[i].dMS << "ms";
+        }
+        SSceneObject &toroidObject=scene[iToroidObject];
+        int iLevel=toroidObject.factory==&lodToroid?lodToroid.level()+1:1;
+        if (iLevel>=lodToroid.levelCount())
+        {
+            toroidObject.factory=&toroid;
+            emit showStatusBarMessage("Torus: full resolution mesh",1000);
+        }
+        else
+        {
+            lodToroid.setLevel(iLevel);
+            lodToroid.setWireframeMode(toroid.wireframeMode());
+            toroidObject.factory=&lodToroid;
+            emit showStatusBarMessage(QString("Torus LOD %1: %2 triangles").arg(iLevel).arg(lodToroid.triangleCount()),1000);
+        }
+    }
+    else if (e->key() == Qt::Key_K)
+    {
+        QString qstrReport=CMeshSimplifier::benchmark(CToroid::torusMesh(1.0f,0.4f,400,200));
+        qDebug() << qstrReport;
+        emit showStatusBarMessage(qstrReport,10000);
+    }
+    else if (e->key() == Qt::Key_P && !scene.isEmpty())
+    {
+        //ground below the torus: off, procedural grid drawn without any vertex buffers, tessellated plane
+        if (iGroundObject<0)
+        {
+            QMatrix4x4 model;
+            model.translate(0.0f,0.0f,-0.6f);
+            iGroundObject=scene.size();
+            scene.append(CRenderQueue::sceneObject(&groundGrid,model));
+            groundGrid.boundingBox(scene[iGroundObject].boundsMin,scene[iGroundObject].boundsMax);
+            emit showStatusBarMessage("Ground: procedural grid",1000);
+        }
+        else if (scene[iGroundObject].factory==&groundGrid)
+        {
+            scene[iGroundObject].factory=&tessPlane;
+            tessPlane.boundingBox(scene[iGroundObject].boundsMin,scene[iGroundObject].boundsMax);
+            emit showStatusBarMessage("Ground: GPU tessellated plane",1000);
+        }
+        else
+        {
+            scene.removeAt(iGroundObject);
+            iGroundObject=-1;
+            emit showStatusBarMessage("Ground: off",1000);
+        }
+    }
+    else if (e->key() == Qt::Key_G)
+    {
+        bBenchmarkGrid=true;
+    }
+    else if (e->key() == Qt::Key_S)
+    {
+        renderCache.setEnabled(!renderCache.isEnabled());
+        emit showStatusBarMessage(QString("Render cache %1").arg(renderCache.isEnabled()?"on":"off"),1000);
+    }
+    else if (e->key() == Qt::Key_F)
+    {
+        bBenchmarkWireframe=true;
+    }
+    else if (e->key() == Qt::Key_V)
+    {
+        //V records a PNG sequence, Shift+V a raw RGBA stream
+        makeCurrent();
+        if (frameRecorder.isRecording())
+        {
+            frameRecorder.stop();
+            emit showStatusBarMessage(frameRecorder.statistics(),5000);
+        }
+        else
+        {
+            QString qstrDirectory=QString("capture_%1").arg(QDateTime::currentDateTime().toString("yyyyMMdd_hhmmss"));
+            if (frameRecorder.start(qstrDirectory,(e->modifiers()&Qt::ShiftModifier)?CFrameRecorder::RawStream:CFrameRecorder::PngSequence))
+                emit showStatusBarMessage(QString("Recording to %1").arg(qstrDirectory),1000);
+        }
+        doneCurrent();
+    }
+    else if (e->key() == Qt::Key_C)
+    {
+        bCaptureFrame=true;
+    }
+    else if (e->key() == Qt::Key_M)
     {
-        this->makeCurrent();
-        //toroid.reshapeTorus(1000,1000);
-        this->doneCurrent();
+        //64 KB still holds the torus, smaller budgets could only be met by evicting visible objects
+        static const qint64 budgets[] = {-1, 1024*1024, 256*1024, 64*1024};
+        int iBudget=0;
+        while (iBudget<3 && budgets[iBudget]!=residency.memoryBudget())
+            iBudget++;
+        makeCurrent();
+        residency.setMemoryBudget(budgets[(iBudget+1)%4]);
+        doneCurrent();
+        emit showStatusBarMessage(residency.memoryBudget()<0?QString("GPU memory budget: unlimited")
+                                  :QString("GPU memory budget: %1 KB").arg(residency.memoryBudget()/1024),1000);
+    }
+    else if (e->key() == Qt::Key_I)
+    {
+        bShowStatistics=!bShowStatistics;
+    }
+    else if (e->key() == Qt::Key_B)
+    {
+        QString qstrReport=CRenderQueue::benchmark(10000);
+        qDebug() << qstrReport;
+        emit showStatusBarMessage(qstrReport,10000);
+    }
+    else if (e->key() == Qt::Key_Plus)
+    {
+        dynamicResolution.setTargetFrameTime(dynamicResolution.targetFrameTime()+1.0);
+    }
+    else if (e->key() == Qt::Key_Minus)
+    {
+        dynamicResolution.setTargetFrameTime(dynamicResolution.targetFrameTime()-1.0);
     }
 }
 
@@ -162,6 +416,133 @@ void MyGLWidget::startRotation(int x, int y)
 
 
 
+void MyGLWidget::showFrameStatus()
+{
+    if ((!dynamicResolution.isEnabled() && !bShowStatistics && !frameRecorder.isRecording()) || statusTimer.elapsed()<500)
+        return;
+    statusTimer.restart();
+    QString qstrStatus;
+    if (dynamicResolution.isEnabled())
+    {
+        QSize size=dynamicResolution.renderSize();
+        qstrStatus+=QString("Render scale: %1\% (%2x%3) GPU frame time: %4 ms (target %5 ms)  ")
+                .arg(qRound(dynamicResolution.scale()*100.0f)).arg(size.width()).arg(size.height())
+                .arg(dynamicResolution.frameTime(),0,'f',2).arg(dynamicResolution.targetFrameTime(),0,'f',1);
+    }
+    if (bShowStatistics)
+    {
+        qstrStatus+=QString("GPU frame time: %1 ms  Stream buffer: %2 bytes/frame, %3 stalls (%4 total)  ")
+                .arg(dynamicResolution.frameTime(),0,'f',2).arg(streamBuffer.frameBytes())
+                .arg(streamBuffer.frameStalls()).arg(streamBuffer.totalStalls());
+        qstrStatus+=QString("Objects: %1 drawn, %2 frustum culled, %3 occlusion culled, %4 queries  ")
+                .arg(occlusionCuller.drawCount()).arg(renderQueue.culledCount()+overlayQueue.culledCount())
+                .arg(occlusionCuller.culledCount()).arg(occlusionCuller.queryCount());
+        qstrStatus+=QString("Resident: %1 KB (peak %2 KB, %3 evictions, %4 pending)  First frame: %5 ms, all resident: %6 ms  ")
+                .arg(residency.residentBytes()/1024.0,0,'f',1).arg(residency.peakBytes()/1024.0,0,'f',1)
+                .arg(residency.evictionCount()).arg(residency.pendingCount())
+                .arg(residency.firstFrameMS(),0,'f',1).arg(residency.allResidentMS(),0,'f',1);
+        if (renderCache.isEnabled())
+            qstrStatus+=QString("Render cache: %1\% hits, %2 ms frame time saved (static layer %3 ms CPU, %4 ms GPU)  ")
+                    .arg(qRound(renderCache.hitRate()*100.0)).arg(renderCache.savedMS(),0,'f',1)
+                    .arg(renderCache.layerCpuMS(),0,'f',2).arg(renderCache.layerGpuMS(),0,'f',2);
+    }
+    if (frameRecorder.isRecording())
+        qstrStatus+=frameRecorder.statistics();
+    emit showStatusBarMessage(qstrStatus.trimmed(),1000);
+}
+
+//draws the CPU torus repeatedly in every wireframe mode and compares the time per draw, including the
+//two pass solid + glPolygonMode overlay the single pass shader mode replaces. The frame's timer query is
+//still running here, so every mode is bracketed by glFinish instead of a nested GL_TIME_ELAPSED query
+void MyGLWidget::benchmarkWireframe(const QMatrix4x4 &camera)
+{
+    const int iDraws=100;
+    if (!toroid.isResident())
+    {
+        emit showStatusBarMessage("Wireframe benchmark: torus is not resident yet",2000);
+        return;
+    }
+    QMatrix4x4 modelView=camera*transformation;
+    QMatrix4x4 modelViewProjection=projection*modelView;
+    QMatrix4x4 normal=modelView.inverted().transposed();
+    CBaseObjectFactory::WireframeMode eOldMode=toroid.wireframeMode();
+
+    static const char *names[] = {"glPolygonMode lines", "shader wireframe", "shader solid + wireframe", "solid + glPolygonMode (2 passes)"};
+    QString qstrReport("Wireframe benchmark (ms per draw):");
+    for (int iMode=0;iMode<4;iMode++)
+    {
+        glFinish();
+        QElapsedTimer cpuTimer;
+        cpuTimer.start();
+        for (int i=0;i<iDraws;i++)
+        {
+            switch (iMode)
+            {
+            case 0: toroid.setWireframeMode(CBaseObjectFactory::PolygonModeWire); break;
+            case 1: toroid.setWireframeMode(CBaseObjectFactory::ShaderWire); break;
+            case 2: toroid.setWireframeMode(CBaseObjectFactory::ShaderSolidWire); break;
+            case 3: toroid.setWireframeMode(CBaseObjectFactory::Solid); break;
+            }
+            toroid.paint(modelViewProjection,modelView,normal);
+            if (iMode==3)
+            {
+                toroid.setWireframeMode(CBaseObjectFactory::PolygonModeWire);
+                toroid.paint(modelViewProjection,modelView,normal);
+            }
+        }
+        glFinish();
+        qstrReport+=QString("  %1: %2").arg(names[iMode]).arg(cpuTimer.nsecsElapsed()/1.0e6/iDraws,0,'f',4);
+    }
+    toroid.setWireframeMode(eOldMode);
+    glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+    qDebug() << qstrReport;
+    emit showStatusBarMessage(qstrReport,10000);
+}
+
+//buffered CPlane against the attribute-less CProceduralGrid for growing grids: creation time,
+//GPU memory and time per draw, bracketed by glFinish like the wireframe benchmark
+void MyGLWidget::benchmarkGrid(const QMatrix4x4 &camera)
+{
+    const int iDraws=20;
+    if (!benchPlane.isProgramReady() && !(benchPlane.initialize(this) && benchGrid.initialize(this)))
+    {
+        emit showStatusBarMessage("Grid benchmark: objects could not be initialized",2000);
+        return;
+    }
+    QMatrix4x4 modelView=camera;
+    QMatrix4x4 modelViewProjection=projection*modelView;
+    QMatrix4x4 normal=modelView.inverted().transposed();
+    auto drawMS=[&](CBaseObjectFactory *object)
+    {
+        glFinish();
+        QElapsedTimer drawTimer;
+        drawTimer.start();
+        for (int i=0;i<iDraws;i++)
+            object->paint(modelViewProjection,modelView,normal);
+        glFinish();
+        return drawTimer.nsecsElapsed()/1.0e6/iDraws;
+    };
+
+    static const int cells[] = {4, 64, 256, 1024};
+    QString qstrReport("Grid benchmark:");
+    for (int i=0;i<4;i++)
+    {
+        glFinish();
+        QElapsedTimer createTimer;
+        createTimer.start();
+        benchPlane.reshapePlane(cells[i]);
+        glFinish();
+        double dCreateMS=createTimer.nsecsElapsed()/1.0e6;
+        benchGrid.reshapeGrid(cells[i],cells[i]);
+        qstrReport+=QString(" %1x%1 cells: buffered %2 KB, %3 ms upload, %4 ms/draw; procedural %5 KB, %6 ms/draw")
+                .arg(cells[i]).arg(benchPlane.residentBytes()/1024.0,0,'f',1).arg(dCreateMS,0,'f',2)
+                .arg(drawMS(&benchPlane),0,'f',3).arg(benchGrid.residentBytes()/1024.0,0,'f',1).arg(drawMS(&benchGrid),0,'f',3);
+    }
+    benchPlane.reshapePlane(4); //release the large buffers
+    qDebug() << qstrReport;
+    emit showStatusBarMessage(qstrReport,10000);
+}
+
 void MyGLWidget::updateProjectionMatrix(int w, int h)
 {
     qreal aspect = qreal(w) / qreal(h ? h : 1);
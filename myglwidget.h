@@ -2,14 +2,19 @@
 #define MYGLWIDGET_H
 
 #include <QOpenGLWidget>
-#include <QOpenGLFunctions_4_0_Core>
 #include <QOpenGLShaderProgram>
 
 #include "renderobjects.h"
+#include "dynamicresolution.h"
+#include "renderqueue.h"
+#include "gltrace.h"
+#include "residency.h"
+#include "framerecorder.h"
+#include "rendercache.h"
 
 
 
-class MyGLWidget : public QOpenGLWidget, QOpenGLFunctions_4_0_Core
+class MyGLWidget : public QOpenGLWidget, CGLTraceFunctions
 {
     Q_OBJECT
 
@@ -40,12 +45,36 @@ private:
 
 
     QTimer *timer;
+    QElapsedTimer statusTimer;
 
 
     CCuboid cuboid;
     CCoordSys coordSys;
     CPlane plane;
     CToroid toroid;
+    CParametricSurface tessToroid;
+    CParametricSurface tessPlane;
+    CLodMesh lodToroid;
+    CProceduralGrid groundGrid;
+    CPlane benchPlane;
+    CProceduralGrid benchGrid;
+
+    CDynamicResolution dynamicResolution;
+    CStreamRingBuffer streamBuffer;
+    COcclusionCuller occlusionCuller;
+    CResidencyManager residency;
+    bool bShowStatistics;
+    bool bCaptureFrame;
+    bool bBenchmarkWireframe;
+    bool bBenchmarkGrid;
+    CFrameRecorder frameRecorder;
+
+    CJobSystem jobSystem;
+    CRenderQueue renderQueue, overlayQueue;
+    CRenderCache renderCache;
+    //scene is the cached static layer, overlay is drawn on top of it every frame
+    QVector<SSceneObject> scene, overlay;
+    int iToroidObject, iCoordSysObject, iGroundObject;
 
 
 
@@ -53,6 +82,9 @@ private:
     void startRotation(int, int);
     void stopRotation();
     void updateProjectionMatrix(int w, int h);
+    void showFrameStatus();
+    void benchmarkWireframe(const QMatrix4x4 &camera);
+    void benchmarkGrid(const QMatrix4x4 &camera);
 };
 
 #endif // MYGLWIDGET_H
@@ -0,0 +1,134 @@
+#include "occlusionculling.h"
+
+#include "gltrace.h"
+#include <QVector4D>
+
+
+COcclusionCuller::COcclusionCuller()
+{}
+COcclusionCuller::~COcclusionCuller()
+{
+    deleteQueries();
+}
+bool COcclusionCuller::initialize(QObject *parent, CGLTraceFunctions *functions)
+{
+    gl=functions;
+    if (!gl)
+    {
+        qDebug() << "OpenGLFunctions not initialized or not supported";
+        return false;
+    }
+    return box.initialize(parent);
+}
+void COcclusionCuller::deleteQueries()
+{
+    for (int i=0;i<states.size();i++)
+        if (states[i].query)
+            gl->glDeleteQueries(1,&states[i].query);
+    states.clear();
+}
+
+void COcclusionCuller::beginFrame()
+{
+    iDraws=iCulled=iQueries=0;
+    for (int i=0;i<states.size();i++)
+    {
+        SQueryState &state=states[i];
+        if (!state.bPending)
+            continue;
+        GLuint uiAvailable=0;
+        gl->glGetQueryObjectuiv(state.query,GL_QUERY_RESULT_AVAILABLE,&uiAvailable);
+        if (!uiAvailable) //keep the last known visibility
+            continue;
+        GLuint uiAnySamples=0;
+        gl->glGetQueryObjectuiv(state.query,GL_QUERY_RESULT,&uiAnySamples);
+        state.bVisible=uiAnySamples!=0;
+        state.bPending=false;
+    }
+}
+
+bool COcclusionCuller::drawObject(int object, const QMatrix4x4 &modelViewProjection, const QVector3D &boundsMin, const QVector3D &boundsMax, const std::function<void()> &draw)
+{
+    if (!bEnabled || object<0)
+    {
+        iDraws++;
+        draw();
+        return true;
+    }
+    while (states.size()<=object)
+    {
+        SQueryState state={0,false,true};
+        states.append(state);
+    }
+    SQueryState &state=states[object];
+    if (state.query==0)
+        gl->glGenQueries(1,&state.query);
+    //a box clipped by the near plane would report hidden samples, always draw it
+    if (touchesNearPlane(modelViewProjection,boundsMin,boundsMax))
+    {
+        state.bVisible=true;
+        iDraws++;
+        draw();
+        return true;
+    }
+    if (state.bVisible)
+    {
+        iDraws++;
+        if (state.bPending)
+        {
+            draw();
+            return true;
+        }
+        //the object itself is the cheapest exact test of its visibility
+        gl->glBeginQuery(GL_ANY_SAMPLES_PASSED,state.query);
+        draw();
+        gl->glEndQuery(GL_ANY_SAMPLES_PASSED);
+        state.bPending=true;
+        iQueries++;
+        return true;
+    }
+    if (!state.bPending)
+    {
+        testBox(state.query,modelViewProjection,boundsMin,boundsMax);
+        state.bPending=true;
+        iQueries++;
+        if (bConditional)
+        {
+            iDraws++;
+            gl->glBeginConditionalRender(state.query,GL_QUERY_NO_WAIT);
+            draw();
+            gl->glEndConditionalRender();
+            return false;
+        }
+    }
+    iCulled++;
+    return false;
+}
+
+bool COcclusionCuller::touchesNearPlane(const QMatrix4x4 &modelViewProjection, const QVector3D &boundsMin, const QVector3D &boundsMax)
+{
+    for (int i=0;i<8;i++)
+    {
+        QVector4D corner(i&1?boundsMax.x():boundsMin.x(),
+                         i&2?boundsMax.y():boundsMin.y(),
+                         i&4?boundsMax.z():boundsMin.z(),1.0f);
+        QVector4D clip=modelViewProjection*corner;
+        if (clip.z()<-clip.w() || clip.w()<=0.0f)
+            return true;
+    }
+    return false;
+}
+
+void COcclusionCuller::testBox(GLuint query, const QMatrix4x4 &modelViewProjection, const QVector3D &boundsMin, const QVector3D &boundsMax)
+{
+    //slightly enlarged so coplanar box faces never fail the depth test against the object itself
+    QVector3D margin=(boundsMax-boundsMin)*0.01f+QVector3D(0.001f,0.001f,0.001f);
+    box.setBox(boundsMin-margin,boundsMax+margin);
+    gl->glColorMask(GL_FALSE,GL_FALSE,GL_FALSE,GL_FALSE);
+    gl->glDepthMask(GL_FALSE);
+    gl->glBeginQuery(GL_ANY_SAMPLES_PASSED,query);
+    box.paint(modelViewProjection);
+    gl->glEndQuery(GL_ANY_SAMPLES_PASSED);
+    gl->glDepthMask(GL_TRUE);
+    gl->glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
+}
@@ -0,0 +1,58 @@
+#ifndef OCCLUSIONCULLING_H
+#define OCCLUSIONCULLING_H
+
+#include "renderobjects.h"
+
+#include <GL/gl.h>
+#include <QtCore>
+#include <QMatrix4x4>
+#include <functional>
+
+
+// Hardware occlusion culling with GL_ANY_SAMPLES_PASSED queries. Every object
+// keeps one query whose result is only read once it is available, so the
+// visibility used in a frame is the last known one (usually the previous
+// frame's) and the CPU never waits for the GPU. Objects that were hidden only
+// get their bounding box tested; with conditional rendering they are drawn
+// depending on that test on the GPU, which avoids popping when they reappear.
+// Objects should be submitted front to back, so occluders fill the depth
+// buffer first.
+class COcclusionCuller
+{
+public:
+    COcclusionCuller();
+    ~COcclusionCuller();
+    bool initialize(QObject *parent, CGLTraceFunctions *);
+    void deleteQueries();
+    void setEnabled(bool enabled) {bEnabled=enabled;}
+    bool isEnabled() const {return bEnabled;}
+    void setConditionalRendering(bool conditional) {bConditional=conditional;}
+    bool conditionalRendering() const {return bConditional;}
+
+    void beginFrame();
+    //returns false if the object was rejected, including draws left to conditional rendering behind a hidden box
+    bool drawObject(int object, const QMatrix4x4 &modelViewProjection, const QVector3D &boundsMin, const QVector3D &boundsMax, const std::function<void()> &draw);
+
+    int drawCount() const {return iDraws;}
+    int culledCount() const {return iCulled;}
+    int queryCount() const {return iQueries;}
+protected:
+    struct SQueryState
+    {
+        GLuint query;
+        bool bPending;
+        bool bVisible;
+    };
+    static bool touchesNearPlane(const QMatrix4x4 &modelViewProjection, const QVector3D &boundsMin, const QVector3D &boundsMax);
+    void testBox(GLuint query, const QMatrix4x4 &modelViewProjection, const QVector3D &boundsMin, const QVector3D &boundsMax);
+    bool bEnabled=false;
+    bool bConditional=false;
+    QVector<SQueryState> states;
+    CBoundingBox box;
+    int iDraws=0;
+    int iCulled=0;
+    int iQueries=0;
+    CGLTraceFunctions* gl = 0;
+};
+
+#endif // OCCLUSIONCULLING_H
@@ -0,0 +1,119 @@
+#include "rendercache.h"
+
+#include "gltrace.h"
+#include <QOpenGLFramebufferObject>
+
+
+CRenderCache::CRenderCache()
+{
+    Timestamps[0]=Timestamps[1]=0;
+}
+CRenderCache::~CRenderCache()
+{
+    deleteFramebuffer();
+    if (gl && Timestamps[0])
+        gl->glDeleteQueries(2,Timestamps);
+}
+bool CRenderCache::initialize(CGLTraceFunctions *functions)
+{
+    gl=functions;
+    if (!gl)
+    {
+        qDebug() << "OpenGLFunctions not initialized or not supported";
+        return false;
+    }
+    //timestamps, not a GL_TIME_ELAPSED query: the frame timer of the dynamic resolution is running already
+    gl->glGenQueries(2,Timestamps);
+    return Timestamps[0]!=0;
+}
+void CRenderCache::deleteFramebuffer()
+{
+    delete fbo;
+    fbo=0;
+    bValid=false;
+}
+void CRenderCache::resize(int w, int h)
+{
+    iWidth=qMax(1,w);
+    iHeight=qMax(1,h);
+    deleteFramebuffer();
+}
+
+// Returns true if the static layer has to be rendered, it then goes into the
+// cache until end(). Otherwise the cached layer has been copied to the target.
+bool CRenderCache::begin(const QSize &renderSize)
+{
+    bRendering=false;
+    if (!gl)
+        return true;
+    if (!bEnabled)
+    {
+        if (fbo)
+            deleteFramebuffer();
+        return true;
+    }
+    pollTimestamps();
+    gl->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING,&iTarget);
+    bool bSameKey=key==lastKey && renderSize==size;
+    if (bValid && bSameKey)
+    {
+        iHits++;
+        //CPU submission and GPU execution of the layer overlap, the frame saves the longer of the two
+        dSavedMS+=qMax(dLayerCpuMS,dLayerGpuMS);
+        copyToTarget();
+        return false;
+    }
+    iMisses++;
+    bStableKey=bSameKey;
+    lastKey=key;
+    size=renderSize;
+    //allocated at full size once, smaller render sizes use its lower left part
+    if (!fbo)
+        fbo = new QOpenGLFramebufferObject(iWidth,iHeight,QOpenGLFramebufferObject::CombinedDepthStencil);
+    fbo->bind();
+    gl->glViewport(0,0,size.width(),size.height());
+    gl->glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+    if (!bTimestampsPending)
+        gl->glQueryCounter(Timestamps[0],GL_TIMESTAMP);
+    cpuTimer.start();
+    bRendering=true;
+    return true;
+}
+void CRenderCache::end()
+{
+    if (!bRendering)
+        return;
+    bRendering=false;
+    dLayerCpuMS=cpuTimer.nsecsElapsed()/1.0e6;
+    if (!bTimestampsPending)
+    {
+        gl->glQueryCounter(Timestamps[1],GL_TIMESTAMP);
+        bTimestampsPending=true;
+    }
+    copyToTarget();
+    bValid=bStableKey;
+}
+
+void CRenderCache::copyToTarget()
+{
+    gl->glBindFramebuffer(GL_READ_FRAMEBUFFER,fbo->handle());
+    gl->glBindFramebuffer(GL_DRAW_FRAMEBUFFER,iTarget);
+    gl->glBlitFramebuffer(0,0,size.width(),size.height(),0,0,size.width(),size.height(),
+                          GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT,GL_NEAREST);
+    gl->glBindFramebuffer(GL_FRAMEBUFFER,iTarget);
+    gl->glViewport(0,0,size.width(),size.height());
+}
+void CRenderCache::pollTimestamps()
+{
+    if (!bTimestampsPending)
+        return;
+    GLint iAvailable=0;
+    gl->glGetQueryObjectiv(Timestamps[1],GL_QUERY_RESULT_AVAILABLE,&iAvailable);
+    if (!iAvailable)
+        return;
+    GLuint64 uiBegin=0, uiEnd=0;
+    gl->glGetQueryObjectui64v(Timestamps[0],GL_QUERY_RESULT,&uiBegin);
+    gl->glGetQueryObjectui64v(Timestamps[1],GL_QUERY_RESULT,&uiEnd);
+    dLayerGpuMS=(uiEnd-uiBegin)/1.0e6;
+    bTimestampsPending=false;
+}
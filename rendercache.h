@@ -0,0 +1,69 @@
+#ifndef RENDERCACHE_H
+#define RENDERCACHE_H
+
+#include <GL/gl.h>
+#include <QtCore>
+#include <QMatrix4x4>
+
+class CGLTraceFunctions;
+class QOpenGLFramebufferObject;
+
+
+// Keeps the color and depth of the static layer of a frame in a framebuffer.
+// The caller describes everything the layer depends on (camera, transforms,
+// object versions) as a key; while the key stays the same the layer is copied
+// into the target instead of being rendered, and dynamic layers are drawn on
+// top with a correct depth buffer. A layer is only reused once the same key
+// was rendered twice in a row, so results lagging one frame (occlusion
+// queries) are settled.
+class CRenderCache
+{
+public:
+    CRenderCache();
+    ~CRenderCache();
+    bool initialize(CGLTraceFunctions *);
+    void deleteFramebuffer();
+    void resize(int w, int h);
+    void setEnabled(bool enabled) {bEnabled=enabled;bValid=false;}
+    bool isEnabled() const {return bEnabled;}
+    void invalidate() {bValid=false;lastKey.clear();}
+
+    void beginKey() {key.clear();}
+    void addKey(const QMatrix4x4 &matrix) {key.append(reinterpret_cast<const char*>(matrix.constData()),16*sizeof(float));}
+    void addKey(const void *pointer) {key.append(reinterpret_cast<const char*>(&pointer),sizeof(pointer));}
+    void addKey(qint64 value) {key.append(reinterpret_cast<const char*>(&value),sizeof(value));}
+    bool begin(const QSize &size);
+    void end();
+
+    int hitCount() const {return iHits;}
+    int missCount() const {return iMisses;}
+    double hitRate() const {return iHits+iMisses>0?(double)iHits/(iHits+iMisses):0.0;}
+    //frame time saved by all hits so far
+    double savedMS() const {return dSavedMS;}
+    double layerCpuMS() const {return dLayerCpuMS;}
+    double layerGpuMS() const {return dLayerGpuMS;}
+protected:
+    void copyToTarget();
+    void pollTimestamps();
+    bool bEnabled=true;
+    bool bValid=false;
+    bool bRendering=false;
+    bool bStableKey=false;
+    QByteArray key, lastKey;
+    QSize size;
+    GLint iTarget=0;
+    int iWidth=1;
+    int iHeight=1;
+    QOpenGLFramebufferObject *fbo=0;
+    GLuint Timestamps[2];
+    bool bTimestampsPending=false;
+    QElapsedTimer cpuTimer;
+    int iHits=0;
+    int iMisses=0;
+    double dSavedMS=0.0;
+    double dLayerCpuMS=0.0;
+    double dLayerGpuMS=0.0;
+    CGLTraceFunctions* gl = 0;
+};
+
+#endif // RENDERCACHE_H
@@ -1,18 +1,29 @@
 #include "renderobjects.h"
+#include "gltrace.h"
+#include "residency.h"
 
 #include <QOpenGLShaderProgram>
 #include <QOpenGLFunctions_4_0_Core>
 #include <QOpenGLContext>
 #include <QtMath>
+#include <QVector2D>
+#include <cstring>
 
 
 
+CStreamRingBuffer *CBaseObjectFactory::streamBuffer=0;
+
 CBaseObjectFactory::CBaseObjectFactory(const QString &name, const QString &vert, const QString &frag)
     :qstrObjectName(name),qstrVertexFile(vert),qstrFragmentFile(frag)
 {VAOs[BaseObject]=0;}
 bool CBaseObjectFactory::initialize(QObject *parent)
 {
-    gl = QOpenGLContext::currentContext()->versionFunctions<QOpenGLFunctions_4_0_Core>();
+    bOk = initializeProgram(parent) && createObject();
+    return bOk;
+}
+bool CBaseObjectFactory::initializeProgram(QObject *parent)
+{
+    gl = CGLTraceFunctions::currentContextFunctions();
 
     if (!gl)
     {
@@ -20,18 +31,38 @@ bool CBaseObjectFactory::initialize(QObject *parent)
         bOk=false;
         return bOk;
     }
-    m_program = new QOpenGLShaderProgram(parent);
-    m_program->addShaderFromSourceFile(QOpenGLShader::Vertex, qstrVertexFile);
-    m_program->addShaderFromSourceFile(QOpenGLShader::Fragment, qstrFragmentFile);
-    bOk=bOk && m_program->link();
-    qDebug() << QString("Shader log of %1:").arg(qstrObjectName) << m_program->log();
-    bOk = bOk && createObject();
+    //with a wireframe geometry shader a second program is linked, solid and glPolygonMode drawing skip the geometry stage
+    m_solidProgram=linkProgram(parent,QString(),qstrFragmentFile);
+    if (bOk && !qstrGeometryFile.isEmpty())
+        m_wireProgram=linkProgram(parent,qstrGeometryFile,qstrWireFragmentFile);
+    m_program=m_solidProgram;
     return bOk;
 }
+QOpenGLShaderProgram *CBaseObjectFactory::linkProgram(QObject *parent, const QString &geometryFile, const QString &fragmentFile)
+{
+    QOpenGLShaderProgram *program = new QOpenGLShaderProgram(parent);
+    program->addShaderFromSourceFile(QOpenGLShader::Vertex, qstrVertexFile);
+    if (!qstrTessControlFile.isEmpty())
+        program->addShaderFromSourceFile(QOpenGLShader::TessellationControl, qstrTessControlFile);
+    if (!qstrTessEvaluationFile.isEmpty())
+        program->addShaderFromSourceFile(QOpenGLShader::TessellationEvaluation, qstrTessEvaluationFile);
+    if (!geometryFile.isEmpty())
+        program->addShaderFromSourceFile(QOpenGLShader::Geometry, geometryFile);
+    program->addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentFile);
+    bOk=bOk && program->link();
+    qDebug() << QString("Shader log of %1:").arg(qstrObjectName) << program->log();
+    if (bOk)
+    {
+        uiPerObjectBlock=gl->glGetUniformBlockIndex(program->programId(),"PerObject");
+        if (uiPerObjectBlock!=GL_INVALID_INDEX)
+            gl->glUniformBlockBinding(program->programId(),uiPerObjectBlock,PerObjectBinding);
+    }
+    return program;
+}
 bool CBaseObjectFactory::createObject()
 {
-    if (!bOk)
-        return bOk;
+    if (!bOk || !isProgramReady())
+        return false;
     gl->glGenVertexArrays(NumVAOs, VAOs);
     if (VAOs[BaseObject]==0)
     {
@@ -41,7 +72,10 @@ bool CBaseObjectFactory::createObject()
     }
     gl->glBindVertexArray(VAOs[BaseObject]);
     qDebug() << "Create Vertex Array Object " << qstrObjectName << ": " << VAOs[BaseObject] ;
+    qint64 iBytesBefore=gl->bufferBytes();
     createBuffers();
+    iResidentBytes=gl->bufferBytes()-iBytesBefore;
+    iVersion++;
     gl->glBindVertexArray(0);
     return bOk;
 }
@@ -53,13 +87,16 @@ void CBaseObjectFactory::deleteObject()
     gl->glBindVertexArray(0);
     deleteBuffers();
     VAOs[BaseObject]=0;
+    iResidentBytes=0;
 }
 bool CBaseObjectFactory::paint(const QMatrix4x4 &modelViewProjectionMatrix)
 {
-    bOk=bOk&&m_program->bind();
+    if (!ensureResident())
+        return bOk;
+    bOk=bOk&&bindProgram();
     if (!bOk || VAOs[BaseObject]==0)
         return bOk;
-    m_program->setUniformValue("mvp_matrix",modelViewProjectionMatrix);
+    setUniform("mvp_matrix",modelViewProjectionMatrix);
     gl->glBindVertexArray(VAOs[BaseObject]);
     uniformsAndDraw();
     gl->glBindVertexArray(0);
@@ -69,21 +106,138 @@ bool CBaseObjectFactory::paint(const QMatrix4x4 &modelViewProjectionMatrix)
 }
 bool CBaseObjectFactory::paint(const QMatrix4x4 &modelViewProjectionMatrix,const QMatrix4x4 &modelViewMatrix, const QMatrix4x4 &normalMatrix)
 {
-    bOk=bOk&&m_program->bind();
+    if (!ensureResident())
+        return bOk;
+    if (usesPerObjectBlock())
+    {
+        GLintptr iOffset=0;
+        char *data=streamBuffer?streamBuffer->allocate(sizeof(SPerObjectBlock),iOffset):0;
+        if (!data)
+        {
+            qDebug() << "No stream buffer space for the per object data of" << qstrObjectName;
+            return false;
+        }
+        fillPerObjectBlock(reinterpret_cast<SPerObjectBlock*>(data),modelViewProjectionMatrix,modelViewMatrix,normalMatrix);
+        streamBuffer->flush();
+        return paint(streamBuffer->buffer(),iOffset);
+    }
+    bOk=bOk&&bindProgram();
     if (!bOk || VAOs[BaseObject]==0)
         return bOk;
-    m_program->setUniformValue("normal_matrix",normalMatrix);
-    m_program->setUniformValue("modelview_matrix",modelViewMatrix);
+    setUniform("normal_matrix",normalMatrix);
+    setUniform("modelview_matrix",modelViewMatrix);
     return paint(modelViewProjectionMatrix);
 }
 bool CBaseObjectFactory::paint(const QMatrix4x4 &modelViewProjectionMatrix, const QMatrix4x4 &projectionMatrix, const QMatrix4x4 &modelViewMatrix, const QMatrix4x4 &normalMatrix)
 {
     Q_UNUSED(projectionMatrix);
-    bOk=bOk&&m_program->bind();
+    if (!ensureResident())
+        return bOk;
+    bOk=bOk&&bindProgram();
     if (!bOk || VAOs[BaseObject]==0)
         return bOk;
     return paint(modelViewProjectionMatrix,modelViewMatrix,normalMatrix);
 }
+bool CBaseObjectFactory::paint(GLuint perObjectBuffer, GLintptr perObjectOffset)
+{
+    if (!ensureResident())
+        return bOk;
+    bOk=bOk&&bindProgram();
+    if (!bOk || VAOs[BaseObject]==0)
+        return bOk;
+    gl->glBindBufferRange(GL_UNIFORM_BUFFER,PerObjectBinding,perObjectBuffer,perObjectOffset,sizeof(SPerObjectBlock));
+    gl->glBindVertexArray(VAOs[BaseObject]);
+    uniformsAndDraw();
+    gl->glBindVertexArray(0);
+    m_program->release();
+    return bOk;
+}
+//objects handled by a residency manager are requested on first use and skipped until they are resident
+bool CBaseObjectFactory::ensureResident()
+{
+    if (!bOk)
+        return false;
+    if (!isProgramReady() || !isResident())
+    {
+        if (residency)
+            residency->request(this);
+        return false;
+    }
+    if (residency)
+        residency->touch(this);
+    return true;
+}
+QVector2D CBaseObjectFactory::viewportSize()
+{
+    GLint viewport[4];
+    gl->glGetIntegerv(GL_VIEWPORT,viewport);
+    return QVector2D(viewport[2],viewport[3]);
+}
+//sets polygon mode and the uniforms of Wireframe.geom/Wireframe_Phong.frag for the current mode,
+//bindProgram has already picked the program with or without the geometry shader
+void CBaseObjectFactory::applyWireframeMode(GLenum polygonModeFace)
+{
+    if (eWireframe==PolygonModeWire)
+    {
+        gl->glPolygonMode(polygonModeFace,GL_LINE);
+        setUniform("wire_mode",(GLint)Solid);
+        return;
+    }
+    gl->glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+    setUniform("wire_mode",(GLint)eWireframe);
+    if (eWireframe==Solid)
+        return;
+    setUniform("viewport",viewportSize());
+    setUniform("line_width",fLineWidth);
+    setUniform("wire_color",QVector3D(1.0f,1.0f,1.0f));
+    setUniform("background_color",QVector3D(0.0f,0.0f,0.0f));
+}
+bool CBaseObjectFactory::bindProgram()
+{
+    bool bShaderWire=eWireframe!=Solid && eWireframe!=PolygonModeWire;
+    m_program=(bShaderWire && m_wireProgram)?m_wireProgram:m_solidProgram;
+    if (!m_program->bind())
+        return false;
+    gl->traceProgram(m_program);
+    return true;
+}
+//uniforms are set through gl, so they end up in GL traces
+void CBaseObjectFactory::setUniform(const char *name, GLint value)
+{
+    GLint iLocation=m_program->uniformLocation(name);
+    if (iLocation!=-1)
+        gl->glUniform1i(iLocation,value);
+}
+void CBaseObjectFactory::setUniform(const char *name, GLfloat value)
+{
+    GLint iLocation=m_program->uniformLocation(name);
+    if (iLocation!=-1)
+        gl->glUniform1f(iLocation,value);
+}
+void CBaseObjectFactory::setUniform(const char *name, const QVector2D &value)
+{
+    GLint iLocation=m_program->uniformLocation(name);
+    if (iLocation!=-1)
+        gl->glUniform2f(iLocation,value.x(),value.y());
+}
+void CBaseObjectFactory::setUniform(const char *name, const QVector3D &value)
+{
+    GLint iLocation=m_program->uniformLocation(name);
+    if (iLocation!=-1)
+        gl->glUniform3f(iLocation,value.x(),value.y(),value.z());
+}
+void CBaseObjectFactory::setUniform(const char *name, const QMatrix4x4 &value)
+{
+    GLint iLocation=m_program->uniformLocation(name);
+    if (iLocation!=-1)
+        gl->glUniformMatrix4fv(iLocation,1,GL_FALSE,value.constData());
+}
+void CBaseObjectFactory::fillPerObjectBlock(SPerObjectBlock *block, const QMatrix4x4 &modelViewProjectionMatrix, const QMatrix4x4 &modelViewMatrix, const QMatrix4x4 &normalMatrix)
+{
+    memcpy(block->mvp,modelViewProjectionMatrix.constData(),sizeof(block->mvp));
+    memcpy(block->modelView,modelViewMatrix.constData(),sizeof(block->modelView));
+    memcpy(block->normal,normalMatrix.constData(),sizeof(block->normal));
+}
 
 
 
@@ -98,31 +252,7 @@ CCoordSys::~CCoordSys()
 }
 bool CCoordSys::createBuffers()
 {
-    GLfloat vertices[6][3] = {
-        { 0.0f, 0.0f, 0.0f},
-        { 1.0f, 0.0f, 0.0f},
-        { 0.0f, 0.0f, 0.0f},
-        { 0.0f, 1.0f, 0.0f},
-        { 0.0f, 0.0f, 0.0f},
-        { 0.0f, 0.0f, 1.0f},
-    };
-    GLfloat colors[6][3] = {
-        { 1.0f, 0.0f, 0.0f},
-        { 1.0f, 0.0f, 0.0f},
-        { 0.0f, 1.0f, 0.0f},
-        { 0.0f, 1.0f, 0.0f},
-        { 0.0f, 0.0f, 1.0f},
-        { 0.0f, 0.0f, 1.0f},
-    };
-    gl->glGenBuffers(NumBuffers, Buffers);
-    gl->glBindBuffer(GL_ARRAY_BUFFER, Buffers[CoordBuffer]);
-    gl->glBufferData(GL_ARRAY_BUFFER, sizeof(vertices),vertices, GL_STATIC_DRAW);
-    gl->glVertexAttribPointer(vPosition, 3, GL_FLOAT,GL_FALSE, 0, BUFFER_OFFSET(0));
-    gl->glEnableVertexAttribArray(vPosition);
-    gl->glBindBuffer(GL_ARRAY_BUFFER, Buffers[ColorBuffer]);
-    gl->glBufferData(GL_ARRAY_BUFFER, sizeof(colors),colors, GL_STATIC_DRAW);
-    gl->glVertexAttribPointer(vColor, 3, GL_FLOAT,GL_FALSE, 0, BUFFER_OFFSET(0));
-    gl->glEnableVertexAttribArray(vColor);
+    //the axes are generated from gl_VertexID, the VAO stays empty
     return true;
 }
 void CCoordSys::uniformsAndDraw()
@@ -130,8 +260,11 @@ void CCoordSys::uniformsAndDraw()
     gl->glDrawArrays(GL_LINES, 0, 6);
 }
 void CCoordSys::deleteBuffers()
+{}
+void CCoordSys::boundingBox(QVector3D &min, QVector3D &max) const
 {
-    gl->glDeleteBuffers(NumBuffers,Buffers);
+    min=QVector3D(0.0f,0.0f,0.0f);
+    max=QVector3D(1.0f,1.0f,1.0f);
 }
 
 
@@ -143,34 +276,33 @@ CCuboid::~CCuboid()
 {
     deleteObject();
 }
+static const GLfloat cuboidVertices[8][3] = {
+    { 0.0f, 0.0f, 0.0f},
+    { 1.0f, 0.0f, 0.0f},
+    { 1.0f, 1.0f, 0.0f},
+    { 0.0f, 1.0f, 0.0f},
+    { 0.0f, 0.0f, 2.0f},
+    { 1.0f, 0.0f, 2.0f},
+    { 1.0f, 1.0f, 2.0f},
+    { 0.0f, 1.0f, 2.0f}
+};
+static const GLuint cuboidTriangles[12][3] = {
+    {0,2,1}, //bottom
+    {0,3,2},
+    {4,5,6}, //top
+    {4,6,7},
+    {4,0,1}, //side 1
+    {4,1,5},
+    {6,2,3}, //side 2
+    {6,3,7},
+    {0,7,3}, //side 3
+    {0,4,7},
+    {1,2,6}, //side 4
+    {1,6,5}
+};
 bool CCuboid::createBuffers()
 {
-     GLfloat vertices[8][3] = {
-         { 0.0f, 0.0f, 0.0f},
-         { 1.0f, 0.0f, 0.0f},
-         { 1.0f, 1.0f, 0.0f},
-         { 0.0f, 1.0f, 0.0f},
-         { 0.0f, 0.0f, 2.0f},
-         { 1.0f, 0.0f, 2.0f},
-         { 1.0f, 1.0f, 2.0f},
-         { 0.0f, 1.0f, 2.0f}
-     };
-
      iTriangleCount=12;
-     GLuint triangles[iTriangleCount][3] = {
-         {0,2,1}, //bottom
-         {0,3,2},
-         {4,5,6}, //top
-         {4,6,7},
-         {4,0,1}, //side 1
-         {4,1,5},
-         {6,2,3}, //side 2
-         {6,3,7},
-         {0,7,3}, //side 3
-         {0,4,7},
-         {1,2,6}, //side 4
-         {1,6,5}
-     };
 
 
  /*    for (int i=0;i<8;i++)
@@ -193,12 +325,12 @@ bool CCuboid::createBuffers()
     gl->glGenBuffers(NumBuffers,Buffers);
 
     gl->glBindBuffer(GL_ARRAY_BUFFER,Buffers[CoordBuffer]);
-    gl->glBufferData(GL_ARRAY_BUFFER,sizeof(vertices),vertices, GL_STATIC_DRAW);
+    gl->glBufferData(GL_ARRAY_BUFFER,sizeof(cuboidVertices),cuboidVertices, GL_STATIC_DRAW);
     gl->glEnableVertexAttribArray(vVertexPosition);
     gl->glVertexAttribPointer(vVertexPosition,3,GL_FLOAT,GL_FALSE,0,BUFFER_OFFSET(0));
 
     gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,Buffers[IndexBuffer]);
-    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(triangles),triangles,GL_STATIC_DRAW);
+    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(cuboidTriangles),cuboidTriangles,GL_STATIC_DRAW);
 
 
 /*     gl->glGenTextures(NumTextures,Textures );
@@ -227,13 +359,31 @@ void CCuboid::deleteBuffers()
 {
     gl->glDeleteBuffers(NumBuffers,Buffers);
 }
+void CCuboid::boundingBox(QVector3D &min, QVector3D &max) const
+{
+    min=QVector3D(0.0f,0.0f,0.0f);
+    max=QVector3D(1.0f,1.0f,2.0f);
+}
+bool CCuboid::meshData(SMeshData &mesh) const
+{
+    mesh=SMeshData();
+    for (int i=0;i<8;i++)
+        mesh.positions << cuboidVertices[i][0] << cuboidVertices[i][1] << cuboidVertices[i][2];
+    for (int i=0;i<12;i++)
+        mesh.indices << cuboidTriangles[i][0] << cuboidTriangles[i][1] << cuboidTriangles[i][2];
+    return true;
+}
 
 
 
 
 CToroid::CToroid()
     :CBaseObjectFactory("Torus",":/Shaders/Fragment_Phong.vert",":/Shaders/Fragment_Phong.frag"),mat(CMaterial::ruby)
-{}
+{
+    qstrGeometryFile=":/Shaders/Wireframe.geom";
+    qstrWireFragmentFile=":/Shaders/Wireframe_Phong.frag";
+    eWireframe=PolygonModeWire;
+}
 CToroid::~CToroid()
 {
     deleteObject();
@@ -249,73 +399,80 @@ void CToroid::reshapeTorus(int rings, int segments)
 {reshapeTorus(fR1,fR2,rings,segments);}
 void CToroid::reshapeTorus(float outerRadius, float innerRadius)
 {reshapeTorus(outerRadius,innerRadius,iRings,iSegments);}
+SMeshData CToroid::torusMesh(float outerRadius, float innerRadius, int rings, int segments)
+{
+    SMeshData mesh;
+    mesh.positions.resize(segments*rings*3);
+    mesh.normals.resize(segments*rings*3);
+    mesh.indices.resize(2*segments*rings*3);
+    GLfloat *vertices=mesh.positions.data();
+    GLfloat *normals=mesh.normals.data();
+    GLuint *triangles=mesh.indices.data();
+    GLfloat fAngleInc1=2.0*M_PI/(GLfloat)rings;
+    GLfloat fAngleInc2=2.0*M_PI/(GLfloat)segments;
+    GLfloat fAngle1=0.0f;
+    int iVertIndex=0;
+    int iFaceIndex=0;
+    for (int i=0;i<rings;i++){
+        GLfloat fAngle2=0.0f;
+        for(int j=0;j<segments;j++)
+        {
+            vertices[iVertIndex]=(outerRadius+innerRadius*cos(fAngle2))*cos(fAngle1);
+            normals[iVertIndex++]=innerRadius*cos(fAngle2)*cos(fAngle1);
+            vertices[iVertIndex]=(outerRadius+innerRadius*cos(fAngle2))*sin(fAngle1);
+            normals[iVertIndex++]=innerRadius*cos(fAngle2)*sin(fAngle1);
+            vertices[iVertIndex]=innerRadius*sin(fAngle2);
+            normals[iVertIndex++]=innerRadius*sin(fAngle2);
+            fAngle2+=fAngleInc2;
+            triangles[iFaceIndex++]=i*segments+j;
+            triangles[iFaceIndex++]=((i+1)%rings)*segments+j;
+            triangles[iFaceIndex++]=((i+1)%rings)*segments+(j+1)%segments;
+            triangles[iFaceIndex++]=i*segments+j;
+            triangles[iFaceIndex++]=((i+1)%rings)*segments+(j+1)%segments;
+            triangles[iFaceIndex++]=i*segments+(j+1)%segments;
+        }
+        fAngle1+=fAngleInc1;
+    }
+    return mesh;
+}
+bool CToroid::meshData(SMeshData &mesh) const
+{
+    mesh=torusMesh(fR1,fR2,iRings,iSegments);
+    return true;
+}
 bool CToroid::createBuffers()
     {
-        iTriangleCount=2*iSegments*iRings;
-         GLfloat *vertices = new GLfloat[iSegments*iRings*3];
-         GLfloat *normals = new GLfloat[iSegments*iRings*3];
-         GLuint *triangles= new GLuint[iTriangleCount*3];
-         for (int i=0;i<iTriangleCount*3;i++)
-             triangles[i]=0;
-         GLfloat fAngleInc1=2.0*M_PI/(GLfloat)iRings;
-         GLfloat fAngleInc2=2.0*M_PI/(GLfloat)iSegments;
-         GLfloat fAngle1=0.0f;
-         int iVertIndex=0;
-         int iFaceIndex=0;
-         for (int i=0;i<iRings;i++){
-             GLfloat fAngle2=0.0f;
-             for(int j=0;j<iSegments;j++)
-             {
-                 vertices[iVertIndex]=(fR1+fR2*cos(fAngle2))*cos(fAngle1);
-                 normals[iVertIndex++]=fR2*cos(fAngle2)*cos(fAngle1);
-                 vertices[iVertIndex]=(fR1+fR2*cos(fAngle2))*sin(fAngle1);
-                 normals[iVertIndex++]=fR2*cos(fAngle2)*sin(fAngle1);
-                 vertices[iVertIndex]=fR2*sin(fAngle2);
-                 normals[iVertIndex++]=fR2*sin(fAngle2);
-                 fAngle2+=fAngleInc2;
-                 triangles[iFaceIndex++]=i*iSegments+j;
-                 triangles[iFaceIndex++]=((i+1)%iRings)*iSegments+j;
-                 triangles[iFaceIndex++]=((i+1)%iRings)*iSegments+(j+1)%iSegments;
-                 triangles[iFaceIndex++]=i*iSegments+j;
-                 triangles[iFaceIndex++]=((i+1)%iRings)*iSegments+(j+1)%iSegments;
-                 triangles[iFaceIndex++]=i*iSegments+(j+1)%iSegments;
-             }
-             fAngle1+=fAngleInc1;
-         }
-
-
+        SMeshData mesh=torusMesh(fR1,fR2,iRings,iSegments);
+        iTriangleCount=mesh.triangleCount();
 
         gl->glGenBuffers(NumBuffers,Buffers);
 
 
         gl->glBindBuffer(GL_ARRAY_BUFFER,Buffers[CoordBuffer]);
-        gl->glBufferData(GL_ARRAY_BUFFER,sizeof(*vertices)*iSegments*iRings*3,vertices, GL_STATIC_DRAW);
+        gl->glBufferData(GL_ARRAY_BUFFER,sizeof(GLfloat)*mesh.positions.size(),mesh.positions.constData(), GL_STATIC_DRAW);
         gl->glEnableVertexAttribArray(vVertexPosition);
         gl->glVertexAttribPointer(vVertexPosition,3,GL_FLOAT,GL_FALSE,0,BUFFER_OFFSET(0));
 
         gl->glBindBuffer(GL_ARRAY_BUFFER,Buffers[NormalBuffer]);
-        gl->glBufferData(GL_ARRAY_BUFFER,sizeof(*normals)*iSegments*iRings*3,normals, GL_STATIC_DRAW);
+        gl->glBufferData(GL_ARRAY_BUFFER,sizeof(GLfloat)*mesh.normals.size(),mesh.normals.constData(), GL_STATIC_DRAW);
         gl->glEnableVertexAttribArray(vVertexNormal);
         gl->glVertexAttribPointer(vVertexNormal,3,GL_FLOAT,GL_TRUE,0,BUFFER_OFFSET(0));
 
 
         gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,Buffers[IndexBuffer]);
-        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(*triangles)*iTriangleCount*3,triangles,GL_STATIC_DRAW);
+        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(GLuint)*mesh.indices.size(),mesh.indices.constData(),GL_STATIC_DRAW);
 
         qDebug() << qstrObjectName << "Coord Buffer: " << Buffers[CoordBuffer] << "Normal Buffer: " << Buffers[NormalBuffer] << "Index Buffer: " << Buffers[IndexBuffer];
 
-        delete[]vertices;
-        delete[]normals;
-        delete[]triangles;
         return true;
 }
 
 void CToroid::uniformsAndDraw()
 {
-    mat.use(m_program);
+    mat.use(m_program,gl);
     gl->glEnable(GL_CULL_FACE);
     gl->glCullFace(GL_BACK);
-    gl->glPolygonMode(GL_FRONT,GL_LINE);
+    applyWireframeMode(GL_FRONT);
     gl->glDrawElements(GL_TRIANGLES,iTriangleCount*3,GL_UNSIGNED_INT,BUFFER_OFFSET(0));
 }
 
@@ -323,6 +480,11 @@ void CToroid::deleteBuffers()
 {
     gl->glDeleteBuffers(NumBuffers,Buffers);
 }
+void CToroid::boundingBox(QVector3D &min, QVector3D &max) const
+{
+    min=QVector3D(-fR1-fR2,-fR1-fR2,-fR2);
+    max=QVector3D(fR1+fR2,fR1+fR2,fR2);
+}
 
 
 
@@ -333,72 +495,71 @@ void CToroid::deleteBuffers()
 
 CPlane::CPlane()
     :CBaseObjectFactory("Plane",":/Shaders/Fragment_Phong.vert",":/Shaders/Fragment_Phong.frag"),mat(CMaterial::gold)
-{}
+{
+    qstrGeometryFile=":/Shaders/Wireframe.geom";
+    qstrWireFragmentFile=":/Shaders/Wireframe_Phong.frag";
+}
 CPlane::~CPlane()
 {
     deleteObject();
 }
+void CPlane::reshapePlane(int cells)
+{
+    iCells=qMax(1,cells);
+    deleteObject();
+    createObject();
+}
+bool CPlane::meshData(SMeshData &mesh) const
+{
+    //cells x cells quads covering [-2,2]
+    mesh=SMeshData();
+    GLfloat fStep=4.0f/iCells;
+    for (int i=0;i<=iCells;i++){
+        for(int j=0;j<=iCells;j++)
+        {
+            mesh.positions << -2.0f+j*fStep << -2.0f+i*fStep << 0.0f;
+            mesh.normals << 0.0f << 0.0f << 1.0f;
+            if (i==iCells || j==iCells)
+                continue;
+            mesh.indices << j+(iCells+1)*i << j+(iCells+1)*(i+1) << j+1+(iCells+1)*(i+1);
+            mesh.indices << j+(iCells+1)*i << j+1+(iCells+1)*(i+1) << j+1+(iCells+1)*i;
+        }
+    }
+    return true;
+}
 bool CPlane::createBuffers()
     {
-        iTriangleCount=32;
-        int iVerticies=25;
-         GLfloat *vertices = new GLfloat[iVerticies*3];
-         GLfloat *normals = new GLfloat[iVerticies*3];
-         GLuint *triangles= new GLuint[iTriangleCount*3];
-         int iVertIndex=0;
-         int iFaceIndex=0;
-         for (int i=0;i<iTriangleCount*3;i++)
-             triangles[i]=0;
-         for (int i=-2;i<3;i++){
-             for(int j=-2;j<3;j++)
-             {
-                 vertices[iVertIndex]=(GLfloat) j;
-                 normals[iVertIndex++]=0.0f;
-                 vertices[iVertIndex]=(GLfloat) i;
-                 normals[iVertIndex++]=0.0f;
-                 vertices[iVertIndex]=0.0f;
-                 normals[iVertIndex++]=1.0f;
-                 if (i==2 || j==2)
-                     continue;
-                 triangles[iFaceIndex++]=j+2+5*(i+2);
-                 triangles[iFaceIndex++]=j+2+5*(i+3);
-                 triangles[iFaceIndex++]=j+3+5*(i+3);
-                 triangles[iFaceIndex++]=j+2+5*(i+2);
-                 triangles[iFaceIndex++]=j+3+5*(i+3);
-                 triangles[iFaceIndex++]=j+3+5*(i+2);
-             }
-         }
+        SMeshData mesh;
+        meshData(mesh);
+        iTriangleCount=mesh.triangleCount();
 
         gl->glGenBuffers(NumBuffers,Buffers);
 
         gl->glBindBuffer(GL_ARRAY_BUFFER,Buffers[CoordBuffer]);
-        gl->glBufferData(GL_ARRAY_BUFFER,sizeof(*vertices)*iVerticies*3,vertices, GL_STATIC_DRAW);
+        gl->glBufferData(GL_ARRAY_BUFFER,sizeof(GLfloat)*mesh.positions.size(),mesh.positions.constData(), GL_STATIC_DRAW);
         gl->glEnableVertexAttribArray(vVertexPosition);
         gl->glVertexAttribPointer(vVertexPosition,3,GL_FLOAT,GL_FALSE,0,BUFFER_OFFSET(0));
 
         gl->glBindBuffer(GL_ARRAY_BUFFER,Buffers[NormalBuffer]);
-        gl->glBufferData(GL_ARRAY_BUFFER,sizeof(*normals)*iVerticies*3,normals, GL_STATIC_DRAW);
+        gl->glBufferData(GL_ARRAY_BUFFER,sizeof(GLfloat)*mesh.normals.size(),mesh.normals.constData(), GL_STATIC_DRAW);
         gl->glEnableVertexAttribArray(vVertexNormal);
         gl->glVertexAttribPointer(vVertexNormal,3,GL_FLOAT,GL_TRUE,0,BUFFER_OFFSET(0));
 
 
         gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,Buffers[IndexBuffer]);
-        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(*triangles)*iTriangleCount*3,triangles,GL_STATIC_DRAW);
+        gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(GLuint)*mesh.indices.size(),mesh.indices.constData(),GL_STATIC_DRAW);
 
         qDebug() << qstrObjectName << "Coord Buffer: " << Buffers[CoordBuffer] << "Normal Buffer: " << Buffers[NormalBuffer] << "Index Buffer: " << Buffers[IndexBuffer];
 
-        delete[]vertices;
-        delete[]normals;
-        delete[]triangles;
         return true;
 }
 
 void CPlane::uniformsAndDraw()
 {
-    mat.use(m_program);
+    mat.use(m_program,gl);
     gl->glDisable(GL_CULL_FACE);
 //    gl->glCullFace(GL_BACK);
-    gl->glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+    applyWireframeMode(GL_FRONT_AND_BACK);
     gl->glDrawElements(GL_TRIANGLES,iTriangleCount*3,GL_UNSIGNED_INT,BUFFER_OFFSET(0));
 }
 
@@ -406,3 +567,285 @@ void CPlane::deleteBuffers()
 {
     gl->glDeleteBuffers(NumBuffers,Buffers);
 }
+void CPlane::boundingBox(QVector3D &min, QVector3D &max) const
+{
+    min=QVector3D(-2.0f,-2.0f,0.0f);
+    max=QVector3D(2.0f,2.0f,0.0f);
+}
+
+
+
+
+CParametricSurface::CParametricSurface(Surface surface)
+    :CBaseObjectFactory(surface==Torus?"Tessellated Torus":"Tessellated Plane",":/Shaders/ParametricSurface.vert",":/Shaders/Fragment_Phong.frag"),
+      eSurface(surface),mat(surface==Torus?CMaterial::ruby:CMaterial::gold)
+{
+    qstrTessControlFile=":/Shaders/ParametricSurface.tesc";
+    qstrTessEvaluationFile=":/Shaders/ParametricSurface.tese";
+    if (eSurface==Plane)
+        iPatchesU=iPatchesV=4;
+}
+CParametricSurface::~CParametricSurface()
+{
+    deleteObject();
+}
+void CParametricSurface::reshapeTorus(float outerRadius, float innerRadius)
+{
+    //the shape lives in uniforms only, the patch grid stays as it is
+    fR1=outerRadius;fR2=innerRadius;
+    iVersion++;
+}
+bool CParametricSurface::createBuffers()
+{
+    int iVertices=(iPatchesU+1)*(iPatchesV+1);
+    GLfloat *parameters = new GLfloat[iVertices*2];
+    GLuint *patches = new GLuint[iPatchesU*iPatchesV*4];
+    int iParamIndex=0;
+    int iPatchIndex=0;
+    for (int i=0;i<=iPatchesV;i++)
+        for (int j=0;j<=iPatchesU;j++)
+        {
+            parameters[iParamIndex++]=(GLfloat)j/(GLfloat)iPatchesU;
+            parameters[iParamIndex++]=(GLfloat)i/(GLfloat)iPatchesV;
+            if (i==iPatchesV || j==iPatchesU)
+                continue;
+            patches[iPatchIndex++]=i*(iPatchesU+1)+j;
+            patches[iPatchIndex++]=i*(iPatchesU+1)+j+1;
+            patches[iPatchIndex++]=(i+1)*(iPatchesU+1)+j+1;
+            patches[iPatchIndex++]=(i+1)*(iPatchesU+1)+j;
+        }
+
+    gl->glGenBuffers(NumBuffers,Buffers);
+
+    gl->glBindBuffer(GL_ARRAY_BUFFER,Buffers[ParameterBuffer]);
+    gl->glBufferData(GL_ARRAY_BUFFER,sizeof(*parameters)*iVertices*2,parameters, GL_STATIC_DRAW);
+    gl->glEnableVertexAttribArray(vParameter);
+    gl->glVertexAttribPointer(vParameter,2,GL_FLOAT,GL_FALSE,0,BUFFER_OFFSET(0));
+
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,Buffers[IndexBuffer]);
+    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(*patches)*iPatchesU*iPatchesV*4,patches,GL_STATIC_DRAW);
+
+    delete[]parameters;
+    delete[]patches;
+    return true;
+}
+void CParametricSurface::uniformsAndDraw()
+{
+    mat.use(m_program,gl);
+    setUniform("surface",(GLint)eSurface);
+    setUniform("r1",fR1);
+    setUniform("r2",fR2);
+    setUniform("plane_extent",QVector2D(fExtent,fExtent));
+    setUniform("viewport",viewportSize());
+    setUniform("edge_pixels",fEdgePixels);
+    gl->glDisable(GL_CULL_FACE);
+    gl->glPolygonMode(GL_FRONT_AND_BACK,bWireframe?GL_LINE:GL_FILL);
+    gl->glPatchParameteri(GL_PATCH_VERTICES,4);
+    gl->glDrawElements(GL_PATCHES,iPatchesU*iPatchesV*4,GL_UNSIGNED_INT,BUFFER_OFFSET(0));
+    gl->glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+}
+void CParametricSurface::deleteBuffers()
+{
+    gl->glDeleteBuffers(NumBuffers,Buffers);
+}
+void CParametricSurface::boundingBox(QVector3D &min, QVector3D &max) const
+{
+    if (eSurface==Plane)
+    {
+        min=QVector3D(-fExtent*0.5f,-fExtent*0.5f,0.0f);
+        max=QVector3D(fExtent*0.5f,fExtent*0.5f,0.0f);
+        return;
+    }
+    min=QVector3D(-fR1-fR2,-fR1-fR2,-fR2);
+    max=QVector3D(fR1+fR2,fR1+fR2,fR2);
+}
+
+
+
+
+CProceduralGrid::CProceduralGrid()
+    :CBaseObjectFactory("Procedural Grid",":/Shaders/ProceduralGrid.vert",":/Shaders/Fragment_Phong.frag"),mat(CMaterial::gold)
+{
+    qstrGeometryFile=":/Shaders/Wireframe.geom";
+    qstrWireFragmentFile=":/Shaders/Wireframe_Phong.frag";
+}
+CProceduralGrid::~CProceduralGrid()
+{
+    deleteObject();
+}
+void CProceduralGrid::reshapeGrid(int cellsX, int cellsY, float extentX, float extentY)
+{
+    //only uniforms change, there is nothing to upload
+    iCellsX=qMax(1,cellsX);iCellsY=qMax(1,cellsY);
+    fExtentX=extentX;fExtentY=extentY;
+    iVersion++;
+}
+bool CProceduralGrid::createBuffers()
+{
+    return true;
+}
+void CProceduralGrid::uniformsAndDraw()
+{
+    mat.use(m_program,gl);
+    setUniform("grid_cells",QVector2D(iCellsX,iCellsY));
+    setUniform("grid_extent",QVector2D(fExtentX,fExtentY));
+    gl->glDisable(GL_CULL_FACE);
+    applyWireframeMode(GL_FRONT_AND_BACK);
+    gl->glDrawArrays(GL_TRIANGLES,0,6*iCellsX*iCellsY);
+}
+void CProceduralGrid::deleteBuffers()
+{}
+void CProceduralGrid::boundingBox(QVector3D &min, QVector3D &max) const
+{
+    min=QVector3D(-fExtentX,-fExtentY,0.0f);
+    max=QVector3D(fExtentX,fExtentY,0.0f);
+}
+
+
+
+CLodMesh::CLodMesh(const QString &name, const CMaterial &material)
+    :CBaseObjectFactory(name,":/Shaders/Fragment_Phong.vert",":/Shaders/Fragment_Phong.frag"),mat(material)
+{
+    qstrGeometryFile=":/Shaders/Wireframe.geom";
+    qstrWireFragmentFile=":/Shaders/Wireframe_Phong.frag";
+}
+CLodMesh::~CLodMesh()
+{
+    deleteObject();
+}
+//the caller deletes the object first if it is resident, the new chain is uploaded on the next paint
+void CLodMesh::setLevels(const QVector<SMeshData> &meshes)
+{
+    levels=meshes;
+    iLevel=0;
+    iVersion++;
+    firstIndex.clear();
+    int iFirst=0;
+    boxMin=boxMax=QVector3D();
+    for (int i=0;i<levels.size();i++)
+    {
+        firstIndex.append(iFirst);
+        iFirst+=levels[i].indices.size();
+    }
+    if (!levels.isEmpty() && levels[0].vertexCount()>0)
+    {
+        const QVector<GLfloat> &positions=levels[0].positions;
+        boxMin=boxMax=QVector3D(positions[0],positions[1],positions[2]);
+        for (int i=0;i<positions.size();i+=3)
+            for (int k=0;k<3;k++)
+            {
+                boxMin[k]=qMin(boxMin[k],positions[i+k]);
+                boxMax[k]=qMax(boxMax[k],positions[i+k]);
+            }
+    }
+}
+bool CLodMesh::createBuffers()
+{
+    //levels are concatenated, indices are rebased so one glDrawElements range draws a level
+    QVector<GLfloat> positions, normals;
+    QVector<GLuint> indices;
+    for (int i=0;i<levels.size();i++)
+    {
+        GLuint uiBase=positions.size()/3;
+        positions+=levels[i].positions;
+        if (levels[i].normals.size()==levels[i].positions.size())
+            normals+=levels[i].normals;
+        else
+            normals+=QVector<GLfloat>(levels[i].positions.size(),0.0f);
+        for (int j=0;j<levels[i].indices.size();j++)
+            indices.append(levels[i].indices[j]+uiBase);
+    }
+    gl->glGenBuffers(NumBuffers,Buffers);
+
+    gl->glBindBuffer(GL_ARRAY_BUFFER,Buffers[CoordBuffer]);
+    gl->glBufferData(GL_ARRAY_BUFFER,sizeof(GLfloat)*positions.size(),positions.constData(), GL_STATIC_DRAW);
+    gl->glEnableVertexAttribArray(vVertexPosition);
+    gl->glVertexAttribPointer(vVertexPosition,3,GL_FLOAT,GL_FALSE,0,BUFFER_OFFSET(0));
+
+    gl->glBindBuffer(GL_ARRAY_BUFFER,Buffers[NormalBuffer]);
+    gl->glBufferData(GL_ARRAY_BUFFER,sizeof(GLfloat)*normals.size(),normals.constData(), GL_STATIC_DRAW);
+    gl->glEnableVertexAttribArray(vVertexNormal);
+    gl->glVertexAttribPointer(vVertexNormal,3,GL_FLOAT,GL_TRUE,0,BUFFER_OFFSET(0));
+
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,Buffers[IndexBuffer]);
+    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(GLuint)*indices.size(),indices.constData(),GL_STATIC_DRAW);
+    return true;
+}
+void CLodMesh::uniformsAndDraw()
+{
+    if (levels.isEmpty())
+        return;
+    mat.use(m_program,gl);
+    gl->glEnable(GL_CULL_FACE);
+    gl->glCullFace(GL_BACK);
+    applyWireframeMode(GL_FRONT);
+    gl->glDrawElements(GL_TRIANGLES,levels[iLevel].indices.size(),GL_UNSIGNED_INT,BUFFER_OFFSET(sizeof(GLuint)*firstIndex[iLevel]));
+}
+void CLodMesh::deleteBuffers()
+{
+    gl->glDeleteBuffers(NumBuffers,Buffers);
+}
+void CLodMesh::boundingBox(QVector3D &min, QVector3D &max) const
+{
+    min=boxMin;
+    max=boxMax;
+}
+bool CLodMesh::meshData(SMeshData &mesh) const
+{
+    if (levels.isEmpty())
+        return false;
+    mesh=levels[iLevel];
+    return true;
+}
+
+
+
+CBoundingBox::CBoundingBox()
+    :CBaseObjectFactory("Bounding Box",":/Shaders/BoundingBox.vert",":/Shaders/BoundingBox.frag"),boxMax(1.0f,1.0f,1.0f)
+{}
+CBoundingBox::~CBoundingBox()
+{
+    deleteObject();
+}
+bool CBoundingBox::createBuffers()
+{
+    GLfloat vertices[8][3] = {
+        { 0.0f, 0.0f, 0.0f},
+        { 1.0f, 0.0f, 0.0f},
+        { 1.0f, 1.0f, 0.0f},
+        { 0.0f, 1.0f, 0.0f},
+        { 0.0f, 0.0f, 1.0f},
+        { 1.0f, 0.0f, 1.0f},
+        { 1.0f, 1.0f, 1.0f},
+        { 0.0f, 1.0f, 1.0f}
+    };
+    //the unit cube shares its index table with the cuboid, only the vertices differ in z
+    gl->glGenBuffers(NumBuffers,Buffers);
+
+    gl->glBindBuffer(GL_ARRAY_BUFFER,Buffers[CoordBuffer]);
+    gl->glBufferData(GL_ARRAY_BUFFER,sizeof(vertices),vertices, GL_STATIC_DRAW);
+    gl->glEnableVertexAttribArray(vVertexPosition);
+    gl->glVertexAttribPointer(vVertexPosition,3,GL_FLOAT,GL_FALSE,0,BUFFER_OFFSET(0));
+
+    gl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,Buffers[IndexBuffer]);
+    gl->glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(cuboidTriangles),cuboidTriangles,GL_STATIC_DRAW);
+    return true;
+}
+void CBoundingBox::uniformsAndDraw()
+{
+    setUniform("box_min",boxMin);
+    setUniform("box_max",boxMax);
+    //both sides and filled, otherwise a box around the camera or a leftover line mode would hide samples
+    gl->glDisable(GL_CULL_FACE);
+    gl->glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+    gl->glDrawElements(GL_TRIANGLES,36,GL_UNSIGNED_INT,BUFFER_OFFSET(0));
+}
+void CBoundingBox::deleteBuffers()
+{
+    gl->glDeleteBuffers(NumBuffers,Buffers);
+}
+void CBoundingBox::boundingBox(QVector3D &min, QVector3D &max) const
+{
+    min=boxMin;
+    max=boxMax;
+}
@@ -4,33 +4,97 @@
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
 #include "matsnlights.h"
+#include "streambuffer.h"
 
 #include <GL/gl.h>
 #include <QtCore>
 
+class CGLTraceFunctions;
+class CResidencyManager;
+class QVector2D;
+
+
+//std140 layout of the PerObject uniform block
+struct SPerObjectBlock
+{
+    GLfloat mvp[16];
+    GLfloat modelView[16];
+    GLfloat normal[16];
+};
+
+
+//indexed triangle mesh on the CPU, three floats per position and normal, normals may be empty
+struct SMeshData
+{
+    QVector<GLfloat> positions;
+    QVector<GLfloat> normals;
+    QVector<GLuint> indices;
+    int vertexCount() const {return positions.size()/3;}
+    int triangleCount() const {return indices.size()/3;}
+};
 
 
 class CBaseObjectFactory
 {
 public:
+    //Solid and PolygonModeWire use the program without geometry shader, the shader modes need the wireframe geometry shader
+    enum WireframeMode { Solid = 0, ShaderWire = 1, ShaderHiddenLine = 2, ShaderSolidWire = 3, PolygonModeWire = 4 };
     CBaseObjectFactory(const QString &name, const QString &vert, const QString &frag);
     virtual ~CBaseObjectFactory(){}
     bool initialize(QObject *);
+    bool initializeProgram(QObject *);
+    bool isProgramReady() const {return m_program!=0;}
+    bool isResident() const {return VAOs[BaseObject]!=0;}
+    qint64 residentBytes() const {return iResidentBytes;}
+    void setResidencyManager(CResidencyManager *manager) {residency=manager;}
+    //changes whenever what the object draws changes, e.g. for caches of rendered images
+    int version() const {return iVersion;}
+    void setWireframeMode(WireframeMode mode) {eWireframe=mode;iVersion++;}
+    WireframeMode wireframeMode() const {return eWireframe;}
+    void setLineWidth(float pixels) {fLineWidth=pixels;iVersion++;}
     bool paint(const QMatrix4x4 &modelViewProjection);
     bool paint(const QMatrix4x4 &modelViewProjection,const QMatrix4x4 &modelViewMatrix, const QMatrix4x4 &normalMatrix);
     bool paint(const QMatrix4x4 &modelViewProjection,const QMatrix4x4 &projectionMatrix, const QMatrix4x4 &modelViewMatrix, const QMatrix4x4 &normalMatrix);
+    bool paint(GLuint perObjectBuffer, GLintptr perObjectOffset);
+    bool usesPerObjectBlock() const {return uiPerObjectBlock!=GL_INVALID_INDEX;}
+    static void fillPerObjectBlock(SPerObjectBlock *block, const QMatrix4x4 &modelViewProjection,const QMatrix4x4 &modelViewMatrix, const QMatrix4x4 &normalMatrix);
+    static void setStreamBuffer(CStreamRingBuffer *buffer) {streamBuffer=buffer;}
     bool createObject();
     void deleteObject();
+    virtual void boundingBox(QVector3D &min, QVector3D &max) const = 0;
+    virtual bool meshData(SMeshData &mesh) const {Q_UNUSED(mesh); return false;}
 protected:
     virtual bool createBuffers() = 0;
     virtual void uniformsAndDraw() = 0;
     virtual void deleteBuffers() = 0;
+    bool ensureResident();
+    QVector2D viewportSize();
+    void applyWireframeMode(GLenum polygonModeFace);
+    bool bindProgram();
+    QOpenGLShaderProgram *linkProgram(QObject *parent, const QString &geometryFile, const QString &fragmentFile);
+    void setUniform(const char *name, GLint value);
+    void setUniform(const char *name, GLfloat value);
+    void setUniform(const char *name, const QVector2D &value);
+    void setUniform(const char *name, const QVector3D &value);
+    void setUniform(const char *name, const QMatrix4x4 &value);
     bool bOk=true;
     QString qstrObjectName, qstrVertexFile, qstrFragmentFile;
+    QString qstrTessControlFile, qstrTessEvaluationFile, qstrGeometryFile, qstrWireFragmentFile;
+    WireframeMode eWireframe=Solid;
+    float fLineWidth=1.5f;
     enum VAO_IDs { BaseObject, NumVAOs };
+    enum Uniform_Block_Bindings { PerObjectBinding = 0 };
     GLuint VAOs[NumVAOs];
-    QOpenGLShaderProgram *m_program;
-    QOpenGLFunctions_4_0_Core* gl = 0;
+    GLuint uiPerObjectBlock=GL_INVALID_INDEX;
+    static CStreamRingBuffer *streamBuffer;
+    //m_program is the one bound for the current wireframe mode
+    QOpenGLShaderProgram *m_program=0;
+    QOpenGLShaderProgram *m_solidProgram=0;
+    QOpenGLShaderProgram *m_wireProgram=0;
+    CGLTraceFunctions* gl = 0;
+    CResidencyManager *residency=0;
+    qint64 iResidentBytes=0;
+    int iVersion=0;
 private:
     CBaseObjectFactory(){}
 };
@@ -41,13 +105,11 @@ class CCoordSys : public CBaseObjectFactory
 public:
     CCoordSys();
     ~CCoordSys();
+    virtual void boundingBox(QVector3D &min, QVector3D &max) const;
 protected:
     virtual bool createBuffers();
     virtual void uniformsAndDraw();
     virtual void deleteBuffers();
-    enum Buffer_IDs { CoordBuffer, ColorBuffer, NumBuffers };
-    enum Attrib_IDs { vPosition = 0 , vColor = 1};
-    GLuint Buffers[NumBuffers];
 };
 
 
@@ -56,6 +118,8 @@ class CCuboid : public CBaseObjectFactory
 public:
     CCuboid();
     ~CCuboid();
+    virtual void boundingBox(QVector3D &min, QVector3D &max) const;
+    virtual bool meshData(SMeshData &mesh) const;
 protected:
     virtual bool createBuffers();
     virtual void uniformsAndDraw();
@@ -82,6 +146,9 @@ public:
     void reshapeTorus(float outerRadius, float innerRadius, int rings, int segments);
     void reshapeTorus(int rings, int segments);
     void reshapeTorus(float outerRadius, float innerRadius);
+    virtual void boundingBox(QVector3D &min, QVector3D &max) const;
+    virtual bool meshData(SMeshData &mesh) const;
+    static SMeshData torusMesh(float outerRadius, float innerRadius, int rings, int segments);
 
 protected:
     virtual bool createBuffers();
@@ -114,6 +181,10 @@ class CPlane : public CBaseObjectFactory
 public:
     CPlane();
     ~CPlane();
+    void reshapePlane(int cells);
+    int cells() const {return iCells;}
+    virtual void boundingBox(QVector3D &min, QVector3D &max) const;
+    virtual bool meshData(SMeshData &mesh) const;
 
 protected:
     virtual bool createBuffers();
@@ -126,9 +197,122 @@ protected:
     GLuint Buffers[NumBuffers];
 
     int iTriangleCount = 2;
+    int iCells = 4;
+    CMaterial mat;
+
+
+};
+
+
+//the same grid as CPlane, generated in the vertex shader from gl_VertexID with an empty VAO
+class CProceduralGrid : public CBaseObjectFactory
+{
+public:
+    CProceduralGrid();
+    ~CProceduralGrid();
+    void reshapeGrid(int cellsX, int cellsY, float extentX=2.0f, float extentY=2.0f);
+    int triangleCount() const {return 2*iCellsX*iCellsY;}
+    virtual void boundingBox(QVector3D &min, QVector3D &max) const;
+
+protected:
+    virtual bool createBuffers();
+    virtual void uniformsAndDraw();
+    virtual void deleteBuffers();
+
+    int iCellsX=4;
+    int iCellsY=4;
+    GLfloat fExtentX=2.0f;
+    GLfloat fExtentY=2.0f;
     CMaterial mat;
+};
 
 
+//torus or plane generated on the GPU from a coarse patch grid, tessellated by screen space edge length
+class CParametricSurface : public CBaseObjectFactory
+{
+public:
+    enum Surface { Torus = 0, Plane = 1 };
+    CParametricSurface(Surface surface);
+    ~CParametricSurface();
+    void reshapeTorus(float outerRadius, float innerRadius);
+    float outerRadius() const {return fR1;}
+    float innerRadius() const {return fR2;}
+    void setEdgeLength(float pixels) {fEdgePixels=qMax(1.0f,pixels);iVersion++;}
+    float edgeLength() const {return fEdgePixels;}
+    void setWireframe(bool wireframe) {bWireframe=wireframe;iVersion++;}
+    virtual void boundingBox(QVector3D &min, QVector3D &max) const;
+
+protected:
+    virtual bool createBuffers();
+    virtual void uniformsAndDraw();
+    virtual void deleteBuffers();
+    enum Buffer_IDs { ParameterBuffer, IndexBuffer, NumBuffers };
+    enum Attrib_IDs { vParameter = 0 };
+
+    GLuint Buffers[NumBuffers];
+
+    Surface eSurface;
+    int iPatchesU=24;
+    int iPatchesV=12;
+    GLfloat fR1=1.0f;
+    GLfloat fR2=0.4f;
+    GLfloat fExtent=4.0f;
+    GLfloat fEdgePixels=8.0f;
+    bool bWireframe=false;
+
+    CMaterial mat;
+};
+
+
+//draws one level of an LOD chain, all levels share one vertex and one index buffer
+class CLodMesh : public CBaseObjectFactory
+{
+public:
+    CLodMesh(const QString &name, const CMaterial &material);
+    ~CLodMesh();
+    void setLevels(const QVector<SMeshData> &meshes);
+    void setLevel(int level) {iLevel=qBound(0,level,qMax(0,levels.size()-1));iVersion++;}
+    int level() const {return iLevel;}
+    int levelCount() const {return levels.size();}
+    int triangleCount() const {return levels.isEmpty()?0:levels[iLevel].triangleCount();}
+    virtual void boundingBox(QVector3D &min, QVector3D &max) const;
+    virtual bool meshData(SMeshData &mesh) const;
+
+protected:
+    virtual bool createBuffers();
+    virtual void uniformsAndDraw();
+    virtual void deleteBuffers();
+    enum Buffer_IDs { CoordBuffer, NormalBuffer, IndexBuffer, NumBuffers };
+    enum Attrib_IDs { vVertexPosition = 0 , vVertexNormal = 1 };
+
+    GLuint Buffers[NumBuffers];
+
+    QVector<SMeshData> levels;
+    QVector<int> firstIndex;
+    int iLevel=0;
+    QVector3D boxMin, boxMax;
+    CMaterial mat;
+};
+
+
+//unit cube scaled to an axis aligned box, used as occlusion query proxy
+class CBoundingBox : public CBaseObjectFactory
+{
+public:
+    CBoundingBox();
+    ~CBoundingBox();
+    void setBox(const QVector3D &min, const QVector3D &max) {boxMin=min;boxMax=max;}
+    virtual void boundingBox(QVector3D &min, QVector3D &max) const;
+
+protected:
+    virtual bool createBuffers();
+    virtual void uniformsAndDraw();
+    virtual void deleteBuffers();
+    enum Buffer_IDs { CoordBuffer, IndexBuffer, NumBuffers };
+    enum Attrib_IDs { vVertexPosition = 0 };
+
+    GLuint Buffers[NumBuffers];
+    QVector3D boxMin, boxMax;
 };
 
 
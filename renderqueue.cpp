@@ -0,0 +1,156 @@
+#include "renderqueue.h"
+
+#include <QtMath>
+#include <QVector4D>
+#include <algorithm>
+
+
+CRenderQueue::CRenderQueue(CJobSystem *jobSystem)
+    :jobs(jobSystem)
+{}
+SSceneObject CRenderQueue::sceneObject(CBaseObjectFactory *factory, const QMatrix4x4 &model)
+{
+    SSceneObject object;
+    object.factory=factory;
+    object.model=model;
+    object.bVisible=true;
+    if (factory)
+        factory->boundingBox(object.boundsMin,object.boundsMax);
+    return object;
+}
+
+bool CRenderQueue::prepareObject(const SSceneObject &object, int index, const QMatrix4x4 &view, const QMatrix4x4 &projection, SDrawPacket &packet)
+{
+    if (!object.bVisible)
+        return false;
+    packet.modelView=view*object.model;
+    packet.modelViewProjection=projection*packet.modelView;
+    //conservative frustum test: culled if all box corners lie outside the same clip plane
+    int iOutside[6]={0,0,0,0,0,0};
+    for (int i=0;i<8;i++)
+    {
+        QVector4D corner(i&1?object.boundsMax.x():object.boundsMin.x(),
+                         i&2?object.boundsMax.y():object.boundsMin.y(),
+                         i&4?object.boundsMax.z():object.boundsMin.z(),1.0f);
+        QVector4D clip=packet.modelViewProjection*corner;
+        if (clip.x()<-clip.w()) iOutside[0]++;
+        if (clip.x()> clip.w()) iOutside[1]++;
+        if (clip.y()<-clip.w()) iOutside[2]++;
+        if (clip.y()> clip.w()) iOutside[3]++;
+        if (clip.z()<-clip.w()) iOutside[4]++;
+        if (clip.z()> clip.w()) iOutside[5]++;
+    }
+    for (int i=0;i<6;i++)
+        if (iOutside[i]==8)
+            return false;
+    packet.factory=object.factory;
+    packet.boundsMin=object.boundsMin;
+    packet.boundsMax=object.boundsMax;
+    packet.normal=packet.modelView.inverted().transposed();
+    packet.fDepth=-(packet.modelView*((object.boundsMin+object.boundsMax)*0.5f)).z();
+    packet.iObject=index;
+    packet.iStreamOffset=-1;
+    return true;
+}
+
+void CRenderQueue::prepare(const QVector<SSceneObject> &scene, const QMatrix4x4 &view, const QMatrix4x4 &projection)
+{
+    threadPackets.resize(jobs->threadCount());
+    for (size_t i=0;i<threadPackets.size();i++)
+        threadPackets[i].clear();
+    const SSceneObject *objects=scene.constData();
+    jobs->parallelFor(scene.size(),64,[&](int begin, int end, int thread){
+        QVector<SDrawPacket> &list=threadPackets[thread];
+        SDrawPacket packet;
+        for (int i=begin;i<end;i++)
+            if (prepareObject(objects[i],i,view,projection,packet))
+                list.append(packet);
+    });
+    drawPackets.clear();
+    for (size_t i=0;i<threadPackets.size();i++)
+        drawPackets+=threadPackets[i];
+    //restore scene order so the submission does not depend on the scheduling
+    std::sort(drawPackets.begin(),drawPackets.end(),[](const SDrawPacket &a, const SDrawPacket &b){return a.iObject<b.iObject;});
+    iCulled=scene.size()-drawPackets.size();
+}
+
+void CRenderQueue::submit(CStreamRingBuffer *stream, COcclusionCuller *culler)
+{
+    if (culler && culler->isEnabled()) //front to back, so the occluders are drawn first
+        std::sort(drawPackets.begin(),drawPackets.end(),[](const SDrawPacket &a, const SDrawPacket &b){return a.fDepth<b.fDepth;});
+    //stream the per object data of all packets first, so it is uploaded with a single map
+    for (int i=0;i<drawPackets.size();i++)
+    {
+        SDrawPacket &packet=drawPackets[i];
+        packet.iStreamOffset=-1;
+        if (!stream || !packet.factory || !packet.factory->usesPerObjectBlock())
+            continue;
+        char *data=stream->allocate(sizeof(SPerObjectBlock),packet.iStreamOffset);
+        if (data)
+            CBaseObjectFactory::fillPerObjectBlock(reinterpret_cast<SPerObjectBlock*>(data),packet.modelViewProjection,packet.modelView,packet.normal);
+        else
+            packet.iStreamOffset=-1;
+    }
+    if (stream)
+        stream->flush();
+    drawn.clear();
+    for (int i=0;i<drawPackets.size();i++)
+    {
+        const SDrawPacket &packet=drawPackets[i];
+        if (!packet.factory)
+            continue;
+        auto draw=[&packet,stream](){
+            if (packet.iStreamOffset>=0)
+                packet.factory->paint(stream->buffer(),packet.iStreamOffset);
+            else
+                packet.factory->paint(packet.modelViewProjection,packet.modelView,packet.normal);
+        };
+        bool bDrawn=true;
+        if (culler)
+            bDrawn=culler->drawObject(packet.iObject,packet.modelViewProjection,packet.boundsMin,packet.boundsMax,draw);
+        else
+            draw();
+        if (bDrawn && !drawn.contains(packet.factory))
+            drawn.append(packet.factory);
+    }
+}
+
+QString CRenderQueue::benchmark(int objectCount, int iterations)
+{
+    QVector<SSceneObject> scene;
+    scene.reserve(objectCount);
+    int iSide=qMax(1,(int)qCeil(qPow(objectCount,1.0/3.0)));
+    for (int i=0;i<objectCount;i++)
+    {
+        SSceneObject object=sceneObject(0);
+        object.model.translate((i%iSide)*3.0f,((i/iSide)%iSide)*3.0f,-(i/(iSide*iSide))*3.0f);
+        object.model.rotate(i*7.0f,QVector3D(1.0f,1.0f,0.0f));
+        object.boundsMin=QVector3D(-1.4f,-1.4f,-0.4f);
+        object.boundsMax=QVector3D(1.4f,1.4f,0.4f);
+        scene.append(object);
+    }
+    QMatrix4x4 view, projection;
+    view.translate(-iSide*1.5f,-iSide*1.5f,-iSide*2.0f);
+    projection.perspective(60.0f,4.0f/3.0f,0.1f,iSide*10.0f);
+
+    QString qstrReport=QString("Scene preparation of %1 objects:").arg(objectCount);
+    double dSingleMS=0.0;
+    int iMaxThreads=qMax(1,QThread::idealThreadCount());
+    for (int iThreads=1;;iThreads=qMin(iThreads*2,iMaxThreads))
+    {
+        CJobSystem jobSystem(iThreads);
+        CRenderQueue queue(&jobSystem);
+        queue.prepare(scene,view,projection); //warm up
+        QElapsedTimer elapsed;
+        elapsed.start();
+        for (int i=0;i<iterations;i++)
+            queue.prepare(scene,view,projection);
+        double dMS=elapsed.nsecsElapsed()/1.0e6/iterations;
+        if (iThreads==1)
+            dSingleMS=dMS;
+        qstrReport+=QString(" %1 threads: %2 ms (x%3)").arg(iThreads).arg(dMS,0,'f',2).arg(dSingleMS/dMS,0,'f',2);
+        if (iThreads==iMaxThreads)
+            break;
+    }
+    return qstrReport;
+}
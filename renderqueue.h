@@ -0,0 +1,57 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "renderobjects.h"
+#include "jobsystem.h"
+#include "occlusionculling.h"
+
+#include <QtCore>
+#include <QMatrix4x4>
+#include <QVector3D>
+
+
+struct SSceneObject
+{
+    CBaseObjectFactory *factory;
+    QMatrix4x4 model;
+    QVector3D boundsMin, boundsMax;
+    bool bVisible;
+};
+
+struct SDrawPacket
+{
+    CBaseObjectFactory *factory;
+    QMatrix4x4 modelViewProjection, modelView, normal;
+    QVector3D boundsMin, boundsMax;
+    float fDepth;
+    int iObject;
+    GLintptr iStreamOffset;
+};
+
+
+// Prepares the per-frame draw list of a scene. Transform composition, frustum
+// culling and packet generation run in parallel on a CJobSystem, each thread
+// writing into its own packet list. The lists are merged afterwards and
+// submitted to GL by the thread owning the context.
+class CRenderQueue
+{
+public:
+    explicit CRenderQueue(CJobSystem *jobSystem);
+    static SSceneObject sceneObject(CBaseObjectFactory *factory, const QMatrix4x4 &model=QMatrix4x4());
+    void prepare(const QVector<SSceneObject> &scene, const QMatrix4x4 &view, const QMatrix4x4 &projection);
+    void submit(CStreamRingBuffer *stream=0, COcclusionCuller *culler=0);
+    const QVector<SDrawPacket> &packets() const {return drawPackets;}
+    //factories of the packets the last submit drew, without frustum and occlusion culled ones
+    const QVector<CBaseObjectFactory*> &drawnFactories() const {return drawn;}
+    int culledCount() const {return iCulled;}
+    static QString benchmark(int objectCount, int iterations=20);
+protected:
+    static bool prepareObject(const SSceneObject &object, int index, const QMatrix4x4 &view, const QMatrix4x4 &projection, SDrawPacket &packet);
+    CJobSystem *jobs;
+    std::vector<QVector<SDrawPacket> > threadPackets;
+    QVector<SDrawPacket> drawPackets;
+    QVector<CBaseObjectFactory*> drawn;
+    int iCulled=0;
+};
+
+#endif // RENDERQUEUE_H
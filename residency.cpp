@@ -0,0 +1,110 @@
+#include "residency.h"
+
+
+CResidencyManager::CResidencyManager()
+{}
+
+void CResidencyManager::manage(CBaseObjectFactory *factory, QObject *programParent)
+{
+    if (entryIndex.contains(factory))
+        return;
+    SEntry entry={factory,programParent,-1};
+    entryIndex.insert(factory,entries.size());
+    entries.append(entry);
+    factory->setResidencyManager(this);
+}
+void CResidencyManager::request(CBaseObjectFactory *factory)
+{
+    if (entryIndex.contains(factory) && !pending.contains(factory))
+        pending.enqueue(factory);
+}
+void CResidencyManager::touch(CBaseObjectFactory *factory)
+{
+    int iIndex=entryIndex.value(factory,-1);
+    if (iIndex>=0)
+        entries[iIndex].iLastDrawn=iFrame;
+}
+
+void CResidencyManager::update(double budgetMS)
+{
+    QElapsedTimer elapsed;
+    elapsed.start();
+    //at least one step per frame, then steps until the time budget is used up, so a compile and an upload usually share a frame
+    while (!pending.isEmpty())
+    {
+        CBaseObjectFactory *factory=pending.head();
+        SEntry &entry=entries[entryIndex.value(factory)];
+        if (!factory->isProgramReady())
+        {
+            if (!factory->initializeProgram(entry.programParent))
+                pending.dequeue();
+        }
+        else
+        {
+            pending.dequeue();
+            if (!factory->isResident())
+                factory->createObject();
+            entry.iLastDrawn=iFrame;
+            enforceBudget(factory);
+        }
+        if (elapsed.nsecsElapsed()/1.0e6>=budgetMS)
+            break;
+    }
+    iPeakBytes=qMax(iPeakBytes,residentBytes());
+    if (dAllResidentMS<0.0 && dFirstFrameMS>=0.0 && pending.isEmpty())
+    {
+        dAllResidentMS=startup.nsecsElapsed()/1.0e6;
+        qDebug() << "Time to first frame:" << dFirstFrameMS << "ms, drawn objects resident after" << dAllResidentMS
+                 << "ms, resident GPU memory:" << residentBytes() << "bytes";
+    }
+}
+
+void CResidencyManager::setMemoryBudget(qint64 bytes)
+{
+    iMemoryBudget=bytes;
+    enforceBudget(0);
+}
+
+//objects drawn in the previous frame are never evicted, a budget below the visible set would otherwise
+//make them evict each other and upload again every frame; the budget is exceeded instead
+void CResidencyManager::enforceBudget(CBaseObjectFactory *keep)
+{
+    if (iMemoryBudget<0)
+        return;
+    while (residentBytes()>iMemoryBudget)
+    {
+        int iVictim=-1;
+        for (int i=0;i<entries.size();i++)
+        {
+            const SEntry &entry=entries[i];
+            if (entry.factory==keep || !entry.factory->isResident() || entry.iLastDrawn>=iFrame-1)
+                continue;
+            if (iVictim<0 || entry.iLastDrawn<entries[iVictim].iLastDrawn)
+                iVictim=i;
+        }
+        if (iVictim<0)
+            break;
+        entries[iVictim].factory->deleteObject();
+        iEvictions++;
+    }
+}
+
+qint64 CResidencyManager::residentBytes() const
+{
+    qint64 iBytes=0;
+    for (int i=0;i<entries.size();i++)
+        iBytes+=entries[i].factory->residentBytes();
+    return iBytes;
+}
+
+void CResidencyManager::startTiming()
+{
+    startup.start();
+    dFirstFrameMS=dAllResidentMS=-1.0;
+}
+void CResidencyManager::frameFinished()
+{
+    if (dFirstFrameMS<0.0 && startup.isValid())
+        dFirstFrameMS=startup.nsecsElapsed()/1.0e6;
+    iFrame++;
+}
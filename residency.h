@@ -0,0 +1,53 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include "renderobjects.h"
+
+#include <QtCore>
+
+
+// Makes render objects resident on first use instead of at startup. A paint
+// of an object that is not resident requests it and draws nothing; update()
+// then compiles its program and uploads its buffers within a time budget per
+// frame. The GPU memory of the managed objects is kept below a budget by
+// evicting the least recently drawn ones that are not currently visible.
+class CResidencyManager
+{
+public:
+    CResidencyManager();
+    void manage(CBaseObjectFactory *factory, QObject *programParent);
+    void request(CBaseObjectFactory *factory);
+    void touch(CBaseObjectFactory *factory);
+    void update(double budgetMS);
+    void startTiming();
+    void frameFinished();
+
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const {return iMemoryBudget;}
+    qint64 residentBytes() const;
+    qint64 peakBytes() const {return iPeakBytes;}
+    int evictionCount() const {return iEvictions;}
+    int pendingCount() const {return pending.size();}
+    double firstFrameMS() const {return dFirstFrameMS;}
+    double allResidentMS() const {return dAllResidentMS;}
+protected:
+    struct SEntry
+    {
+        CBaseObjectFactory *factory;
+        QObject *programParent;
+        int iLastDrawn;
+    };
+    void enforceBudget(CBaseObjectFactory *keep);
+    QVector<SEntry> entries;
+    QHash<CBaseObjectFactory*,int> entryIndex;
+    QQueue<CBaseObjectFactory*> pending;
+    int iFrame=0;
+    qint64 iMemoryBudget=-1;
+    qint64 iPeakBytes=0;
+    int iEvictions=0;
+    QElapsedTimer startup;
+    double dFirstFrameMS=-1.0;
+    double dAllResidentMS=-1.0;
+};
+
+#endif // RESIDENCY_H
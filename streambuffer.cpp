@@ -0,0 +1,125 @@
+#include "streambuffer.h"
+
+#include "gltrace.h"
+#include <cstring>
+
+
+CStreamRingBuffer::CStreamRingBuffer(GLenum target, GLsizeiptr regionSize)
+    :eTarget(target),iRegionSize(regionSize)
+{
+    for (int i=0;i<NumRegions;i++)
+        Fences[i]=0;
+}
+CStreamRingBuffer::~CStreamRingBuffer()
+{
+    deleteBuffer();
+}
+bool CStreamRingBuffer::initialize(CGLTraceFunctions *functions)
+{
+    gl=functions;
+    if (!gl)
+    {
+        qDebug() << "OpenGLFunctions not initialized or not supported";
+        return false;
+    }
+    if (eTarget==GL_UNIFORM_BUFFER)
+        gl->glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT,&iAlignment);
+    iAlignment=qMax(iAlignment,16);
+    gl->glGenBuffers(1,&uiBuffer);
+    if (uiBuffer==0)
+    {
+        qDebug() << "Error creating stream buffer";
+        return false;
+    }
+    gl->glBindBuffer(eTarget,uiBuffer);
+    gl->glBufferData(eTarget,iRegionSize*NumRegions,NULL,GL_STREAM_DRAW);
+    gl->glBindBuffer(eTarget,0);
+    staging.resize(iRegionSize);
+    return true;
+}
+void CStreamRingBuffer::deleteBuffer()
+{
+    if (uiBuffer==0)
+        return;
+    for (int i=0;i<NumRegions;i++)
+    {
+        if (Fences[i])
+            gl->glDeleteSync(Fences[i]);
+        Fences[i]=0;
+    }
+    gl->glDeleteBuffers(1,&uiBuffer);
+    uiBuffer=0;
+}
+
+void CStreamRingBuffer::beginFrame()
+{
+    if (uiBuffer==0)
+        return;
+    iRegion=(iRegion+1)%NumRegions;
+    iHead=iFlushed=0;
+    iFrameBytes=0;
+    iFrameStalls=0;
+    bInFrame=true;
+    GLsync fence=Fences[iRegion];
+    if (!fence)
+        return;
+    GLenum eResult=gl->glClientWaitSync(fence,0,0);
+    if (eResult==GL_TIMEOUT_EXPIRED)
+    {
+        //the GPU still reads this region, we have to wait for it
+        iFrameStalls++;
+        iTotalStalls++;
+        do
+            eResult=gl->glClientWaitSync(fence,GL_SYNC_FLUSH_COMMANDS_BIT,1000000);
+        while (eResult==GL_TIMEOUT_EXPIRED);
+    }
+    if (eResult==GL_WAIT_FAILED)
+        qDebug() << "Waiting for stream buffer fence failed";
+    gl->glDeleteSync(fence);
+    Fences[iRegion]=0;
+}
+void CStreamRingBuffer::endFrame()
+{
+    if (!bInFrame)
+        return;
+    flush();
+    Fences[iRegion]=gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+    bInFrame=false;
+}
+
+char *CStreamRingBuffer::allocate(GLsizeiptr size, GLintptr &offset, GLint alignment)
+{
+    if (!bInFrame || size<=0)
+        return 0;
+    alignment=qMax(alignment,iAlignment);
+    GLsizeiptr iStart=(iHead+alignment-1)/alignment*alignment;
+    if (iStart+size>iRegionSize)
+    {
+        if (!bOverflowReported)
+            qDebug() << "Stream buffer region of" << iRegionSize << "bytes exhausted";
+        bOverflowReported=true;
+        return 0;
+    }
+    iHead=iStart+size;
+    iFrameBytes+=size;
+    offset=iRegion*iRegionSize+iStart;
+    return staging.data()+iStart;
+}
+void CStreamRingBuffer::flush()
+{
+    if (iHead<=iFlushed)
+        return;
+    gl->glBindBuffer(eTarget,uiBuffer);
+    void *mapped=gl->glMapBufferRange(eTarget,iRegion*iRegionSize+iFlushed,iHead-iFlushed,
+                                      GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_RANGE_BIT|GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped)
+    {
+        memcpy(mapped,staging.constData()+iFlushed,iHead-iFlushed);
+        gl->glUnmapBuffer(eTarget);
+        gl->traceMappedWrite(eTarget,iRegion*iRegionSize+iFlushed,staging.constData()+iFlushed,iHead-iFlushed);
+    }
+    else
+        qDebug() << "Mapping stream buffer failed";
+    gl->glBindBuffer(eTarget,0);
+    iFlushed=iHead;
+}
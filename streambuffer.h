@@ -0,0 +1,54 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <GL/gl.h>
+#include <qopengl.h>
+#include <QtCore>
+
+class CGLTraceFunctions;
+
+
+// Ring allocator for data that changes every frame (uniform blocks, instance
+// data). The buffer is split into NumRegions regions, one per frame in flight.
+// A region is only reused once the fence set at the end of its frame has
+// signaled, so the GPU never reads data that is being overwritten.
+// Allocations are staged on the CPU and uploaded in one unsynchronized map per
+// flush().
+class CStreamRingBuffer
+{
+public:
+    CStreamRingBuffer(GLenum target=GL_UNIFORM_BUFFER, GLsizeiptr regionSize=1024*1024);
+    ~CStreamRingBuffer();
+    bool initialize(CGLTraceFunctions *);
+    void deleteBuffer();
+    void beginFrame();
+    void endFrame();
+    char *allocate(GLsizeiptr size, GLintptr &offset, GLint alignment=0);
+    void flush();
+
+    GLuint buffer() const {return uiBuffer;}
+    GLenum target() const {return eTarget;}
+    GLint alignment() const {return iAlignment;}
+    int frameStalls() const {return iFrameStalls;}
+    int totalStalls() const {return iTotalStalls;}
+    qint64 frameBytes() const {return iFrameBytes;}
+protected:
+    enum { NumRegions = 3 };
+    GLenum eTarget;
+    GLsizeiptr iRegionSize;
+    GLuint uiBuffer=0;
+    GLsync Fences[NumRegions];
+    int iRegion=0;
+    GLsizeiptr iHead=0;
+    GLsizeiptr iFlushed=0;
+    GLint iAlignment=1;
+    bool bInFrame=false;
+    bool bOverflowReported=false;
+    QByteArray staging;
+    int iFrameStalls=0;
+    int iTotalStalls=0;
+    qint64 iFrameBytes=0;
+    CGLTraceFunctions* gl = 0;
+};
+
+#endif // STREAMBUFFER_H